@@ -7,24 +7,660 @@
 #include <limits>
 #include <algorithm>
 #include <stdexcept>
+#include <string_view>
+#include <charconv>
+#include <cstring>
+#include <unordered_map>
+#include <unordered_set>
+#include <thread>
+#include <cstdio>
+#include <cstdint>
+#include <ctime>
+#include <map>
+#include <array>
+#include <set>
+#include <tuple>
+#include <memory>
+#include <random>
+#include <sys/wait.h>
+#include <cerrno>
+#include <filesystem>
+#include <mutex>
+#include <functional>
+#include <queue>
+#include <deque>
+#include <shared_mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <csignal>
 
 // Using standard namespace for convenience
 using namespace std;
 
+// ----------------- Instrumentation -----------------
+
+// Formats a duration given in microseconds with a readable unit
+string formatDuration(double micros) {
+    stringstream ss;
+    ss << fixed << setprecision(2);
+    if (micros < 1.0) ss << micros * 1000.0 << " ns";
+    else if (micros < 1000.0) ss << micros << " us";
+    else if (micros < 1e6) ss << micros / 1000.0 << " ms";
+    else ss << micros / 1e6 << " s";
+    return ss.str();
+}
+
+// Timers and counters showing where the time goes: file loads and saves,
+// reference IDs, journal writes, console output and every menu action.
+// STATS_TIME(name) times the rest of the enclosing scope and
+// STATS_COUNT(name, amount) adds to a counter; each call site looks its
+// metric up once, so the running cost is a clock read or an atomic add.
+// Build with -DHOTEL_STATS=0 to compile all of it out.
+#ifndef HOTEL_STATS
+#define HOTEL_STATS 1
+#endif
+
+#if HOTEL_STATS
+
+// Latency histogram with power-of-two buckets: bucket i counts samples of
+// [2^i, 2^(i+1)) nanoseconds. Safe to record into from several threads.
+class LatencyHistogram {
+public:
+    static const size_t BUCKETS = 48;
+
+    void record(uint64_t nanos) {
+        size_t bucket = nanos == 0 ? 0 : min<size_t>(BUCKETS - 1, static_cast<size_t>(63 - __builtin_clzll(nanos)));
+        buckets[bucket].fetch_add(1, memory_order_relaxed);
+        count.fetch_add(1, memory_order_relaxed);
+        total.fetch_add(nanos, memory_order_relaxed);
+        uint64_t seen = maximum.load(memory_order_relaxed);
+        while (nanos > seen && !maximum.compare_exchange_weak(seen, nanos, memory_order_relaxed)) {}
+    }
+
+    uint64_t samples() const { return count.load(memory_order_relaxed); }
+    uint64_t totalNanos() const { return total.load(memory_order_relaxed); }
+    uint64_t maxNanos() const { return maximum.load(memory_order_relaxed); }
+
+    // Upper end of the bucket holding the q-quantile, capped at the maximum
+    uint64_t quantileNanos(double q) const {
+        uint64_t n = samples();
+        if (n == 0) return 0;
+        uint64_t rank = max<uint64_t>(1, static_cast<uint64_t>(ceil(q * static_cast<double>(n))));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < BUCKETS; ++i) {
+            seen += buckets[i].load(memory_order_relaxed);
+            if (seen >= rank) return min(maxNanos(), (uint64_t(2) << i) - 1);
+        }
+        return maxNanos();
+    }
+
+private:
+    array<atomic<uint64_t>, BUCKETS> buckets{};
+    atomic<uint64_t> count{0}, total{0}, maximum{0};
+};
+
+// Every timer and counter of the process, by name
+class Stats {
+public:
+    // The metric called name, created on first use; it never moves
+    LatencyHistogram& timer(const string& name) {
+        lock_guard<mutex> guard(lock);
+        auto& slot = timers[name];
+        if (!slot) slot = make_unique<LatencyHistogram>();
+        return *slot;
+    }
+
+    atomic<uint64_t>& counter(const string& name) {
+        lock_guard<mutex> guard(lock);
+        auto& slot = counters[name];
+        if (!slot) slot = make_unique<atomic<uint64_t>>(0);
+        return *slot;
+    }
+
+    // Human-readable table of every metric used so far
+    void print(ostream& out) const {
+        lock_guard<mutex> guard(lock);
+        out << left << setw(28) << "Timer" << right << setw(10) << "count" << setw(13) << "mean"
+            << setw(13) << "p50" << setw(13) << "p99" << setw(13) << "max" << "\n";
+        for (const auto& [name, h] : timers) {
+            uint64_t n = h->samples();
+            out << left << setw(28) << name << right << setw(10) << n
+                << setw(13) << formatDuration(n ? h->totalNanos() / 1000.0 / static_cast<double>(n) : 0.0)
+                << setw(13) << formatDuration(h->quantileNanos(0.50) / 1000.0)
+                << setw(13) << formatDuration(h->quantileNanos(0.99) / 1000.0)
+                << setw(13) << formatDuration(h->maxNanos() / 1000.0) << "\n";
+        }
+        out << "\n" << left << setw(28) << "Counter" << right << setw(16) << "value" << "\n";
+        for (const auto& [name, value] : counters)
+            out << left << setw(28) << name << right << setw(16) << value->load(memory_order_relaxed) << "\n";
+    }
+
+    // The same as one JSON object; latencies are in nanoseconds
+    string toJson() const {
+        lock_guard<mutex> guard(lock);
+        string json = "{\n  \"timers\": {";
+        const char* separator = "\n";
+        for (const auto& [name, h] : timers) {
+            uint64_t n = h->samples();
+            json += separator;
+            json += "    \"" + name + "\": {\"count\": " + to_string(n) +
+                    ", \"total_ns\": " + to_string(h->totalNanos()) +
+                    ", \"mean_ns\": " + to_string(n ? h->totalNanos() / n : 0) +
+                    ", \"p50_ns\": " + to_string(h->quantileNanos(0.50)) +
+                    ", \"p90_ns\": " + to_string(h->quantileNanos(0.90)) +
+                    ", \"p99_ns\": " + to_string(h->quantileNanos(0.99)) +
+                    ", \"max_ns\": " + to_string(h->maxNanos()) + "}";
+            separator = ",\n";
+        }
+        json += "\n  },\n  \"counters\": {";
+        separator = "\n";
+        for (const auto& [name, value] : counters) {
+            json += separator;
+            json += "    \"" + name + "\": " + to_string(value->load(memory_order_relaxed));
+            separator = ",\n";
+        }
+        json += "\n  }\n}\n";
+        return json;
+    }
+
+private:
+    mutable mutex lock;
+    map<string, unique_ptr<LatencyHistogram>> timers;
+    map<string, unique_ptr<atomic<uint64_t>>> counters;
+};
+
+// The process's statistics. Never destroyed, so they can still be dumped
+// from exit handlers after static objects are gone.
+Stats& stats() {
+    static Stats* instance = new Stats;
+    return *instance;
+}
+
+// Records the lifetime of the object into a histogram
+class ScopedTimer {
+public:
+    explicit ScopedTimer(LatencyHistogram& target) : histogram(target), start(chrono::steady_clock::now()) {}
+    ~ScopedTimer() {
+        auto elapsed = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start);
+        histogram.record(static_cast<uint64_t>(elapsed.count()));
+    }
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+private:
+    LatencyHistogram& histogram;
+    chrono::steady_clock::time_point start;
+};
+
+#define STATS_JOIN2(a, b) a##b
+#define STATS_JOIN(a, b) STATS_JOIN2(a, b)
+#define STATS_TIME(name)                                                             \
+    static LatencyHistogram& STATS_JOIN(statsTimer, __LINE__) = stats().timer(name); \
+    ScopedTimer STATS_JOIN(statsScope, __LINE__)(STATS_JOIN(statsTimer, __LINE__))
+#define STATS_COUNT(name, amount)                                                             \
+    do {                                                                                      \
+        static atomic<uint64_t>& statsCounter = stats().counter(name);                        \
+        statsCounter.fetch_add(static_cast<uint64_t>(amount), memory_order_relaxed);          \
+    } while (0)
+
+// Writes the statistics as JSON to path
+void writeStatsJson(const string& path) {
+    string json = stats().toJson();
+    ofstream out(path, ios::trunc);
+    if (!(out << json)) cerr << "Unable to write statistics to " << path << "\n";
+}
+
+#else
+
+#define STATS_TIME(name) ((void)0)
+#define STATS_COUNT(name, amount) ((void)sizeof(amount))
+
+#endif
+
+// ----------------- Dates -----------------
+
+// Dates are held as day numbers (days since 1970-01-01) and written as YYYY-MM-DD
+const int NO_DATE = numeric_limits<int>::min(); // Check-in of bookings made before dates were tracked
+
+// Day number of a calendar date (proleptic Gregorian)
+int daysFromCivil(int y, unsigned m, unsigned d) {
+    y -= m <= 2;
+    const int era = (y >= 0 ? y : y - 399) / 400;
+    const unsigned yoe = static_cast<unsigned>(y - era * 400);
+    const unsigned doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + static_cast<int>(doe) - 719468;
+}
+
+// Calendar date of a day number
+void civilFromDays(int z, int& y, unsigned& m, unsigned& d) {
+    z += 719468;
+    const int era = (z >= 0 ? z : z - 146096) / 146097;
+    const unsigned doe = static_cast<unsigned>(z - era * 146097);
+    const unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    const unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    const unsigned mp = (5 * doy + 2) / 153;
+    d = doy - (153 * mp + 2) / 5 + 1;
+    m = mp < 10 ? mp + 3 : mp - 9;
+    y = static_cast<int>(yoe) + era * 400 + (m <= 2);
+}
+
+// Formats a day number as YYYY-MM-DD
+string formatDate(int day) {
+    int y; unsigned m, d;
+    civilFromDays(day, y, m, d);
+    char buf[16];
+    snprintf(buf, sizeof buf, "%04d-%02u-%02u", y, m, d);
+    return buf;
+}
+
+// Parses YYYY-MM-DD into a day number; returns false if it is not a real date
+bool parseDate(string_view text, int& day) {
+    if (text.size() != 10 || text[4] != '-' || text[7] != '-') return false;
+    auto digits = [&](size_t from, size_t count) {
+        int value = 0;
+        for (size_t i = from; i < from + count; ++i) {
+            if (!isdigit(static_cast<unsigned char>(text[i]))) return -1;
+            value = value * 10 + (text[i] - '0');
+        }
+        return value;
+    };
+
+    int y = digits(0, 4);
+    int month = digits(5, 2), dayOfMonth = digits(8, 2);
+    if (y < 0 || month < 0 || dayOfMonth < 0) return false;
+    unsigned m = static_cast<unsigned>(month), d = static_cast<unsigned>(dayOfMonth);
+    if (m < 1 || m > 12 || d < 1 || d > 31) return false;
+
+    int candidate = daysFromCivil(y, m, d);
+    int cy; unsigned cm, cd;
+    civilFromDays(candidate, cy, cm, cd);
+    if (cy != y || cm != m || cd != d) return false; // e.g. 2025-02-30
+    day = candidate;
+    return true;
+}
+
+// Today's day number in local time
+int today() {
+    time_t now = time(nullptr);
+    tm local{};
+    localtime_r(&now, &local);
+    return daysFromCivil(local.tm_year + 1900, static_cast<unsigned>(local.tm_mon + 1), static_cast<unsigned>(local.tm_mday));
+}
+
 // ----------------- Models -----------------
 
+// The store keeps every room and booking in memory, so records are kept
+// compact: text that repeats across records (room types, guest names) is
+// interned and held as a small id, money is held in whole cents and
+// reference IDs by their number. Each field reads as the string or double
+// it stands for, so code using the records does not see the difference.
+
+// Table of the distinct strings used by one kind of field. Ids are dense
+// and the text behind an id never changes while the id is held, so reading
+// it takes no lock. Id 0 is always "".
+// A counted pool tracks how many values hold each id (see InternedString)
+// and reuses an id once the last one lets go, so fields whose values come
+// and go, like guest names in a long-running server, stay at the size of
+// what is in use. An uncounted pool only ever grows, for fields with a
+// handful of values. Either way the capacity bounds the ids in use at once.
+class InternPool {
+public:
+    InternPool(size_t capacity, bool counted)
+        : limit(capacity), counting(counted), blocks(new atomic<Block*>[(capacity + BLOCK_SIZE - 1) / BLOCK_SIZE]()) {
+        intern("");
+    }
+
+    // Id of text, adding it if it is new; the caller holds the id once more.
+    // Throws if the pool is full.
+    uint32_t intern(string_view text) {
+        {
+            shared_lock<shared_mutex> guard(lock);
+            auto it = ids.find(text);
+            if (it != ids.end()) {
+                hold(it->second); // Under the lock, so a concurrent release() cannot free it first
+                return it->second;
+            }
+        }
+        unique_lock<shared_mutex> guard(lock);
+        auto it = ids.find(text);
+        if (it != ids.end()) {
+            hold(it->second);
+            return it->second;
+        }
+
+        uint32_t id;
+        if (!freeIds.empty()) {
+            id = freeIds.back();
+            freeIds.pop_back();
+        } else {
+            if (count == limit) throw runtime_error("too many distinct values in use for an interned field");
+            id = static_cast<uint32_t>(count++);
+            if (!blocks[id / BLOCK_SIZE].load(memory_order_relaxed))
+                blocks[id / BLOCK_SIZE].store(new Block, memory_order_release);
+        }
+        string& stored = slot(id).text;
+        stored.assign(text.data(), text.size());
+        if (stored.capacity() > string().capacity()) textBytes += stored.capacity() + 1;
+        ids.emplace(stored, id);
+        slot(id).holders.store(1, memory_order_relaxed);
+        return id;
+    }
+
+    // Records one more holder of id
+    void hold(uint32_t id) {
+        if (counting && id != 0) slot(id).holders.fetch_add(1, memory_order_relaxed);
+    }
+
+    // Records that a holder of id let go; the last one frees it for reuse
+    void release(uint32_t id) {
+        if (!counting || id == 0 || slot(id).holders.fetch_sub(1, memory_order_acq_rel) != 1) return;
+        unique_lock<shared_mutex> guard(lock);
+        Slot& freed = slot(id);
+        if (freed.holders.load(memory_order_relaxed) != 0) return; // Interned again meanwhile
+        auto it = ids.find(freed.text);
+        if (it == ids.end() || it->second != id) return; // Freed already by an earlier last holder
+        ids.erase(it);
+        if (freed.text.capacity() > string().capacity()) textBytes -= freed.text.capacity() + 1;
+        string().swap(freed.text);
+        freeIds.push_back(id);
+    }
+
+    // Looks text up without adding or holding it; returns false if no record uses it
+    bool find(string_view text, uint32_t& id) const {
+        shared_lock<shared_mutex> guard(lock);
+        auto it = ids.find(text);
+        if (it == ids.end()) return false;
+        id = it->second;
+        return true;
+    }
+
+    const string& text(uint32_t id) const { return slot(id).text; }
+
+    // Ids in use
+    size_t size() const {
+        shared_lock<shared_mutex> guard(lock);
+        return ids.size();
+    }
+
+    // Approximate heap bytes held by the pool, for the memory benchmark
+    size_t bytes() const {
+        shared_lock<shared_mutex> guard(lock);
+        size_t allocated = (count + BLOCK_SIZE - 1) / BLOCK_SIZE * sizeof(Block) + freeIds.capacity() * sizeof(uint32_t);
+        size_t index = ids.bucket_count() * sizeof(void*) + ids.size() * (sizeof(pair<string_view, uint32_t>) + 2 * sizeof(void*));
+        return allocated + textBytes + index;
+    }
+
+private:
+    static constexpr size_t BLOCK_SIZE = 4096;
+    struct Slot {
+        string text;
+        atomic<uint32_t> holders{0};
+    };
+    using Block = array<Slot, BLOCK_SIZE>;
+
+    const size_t limit;
+    const bool counting;
+    unique_ptr<atomic<Block*>[]> blocks; // Blocks of BLOCK_SIZE slots, allocated as needed
+    unordered_map<string_view, uint32_t> ids; // Views of the stored strings
+    vector<uint32_t> freeIds; // Released ids, reused before new ones
+    size_t count = 0;         // Ids ever handed out, in use or free
+    size_t textBytes = 0;     // Heap bytes of strings too long to be stored inline
+    mutable shared_mutex lock;
+
+    Slot& slot(uint32_t id) const { return (*blocks[id / BLOCK_SIZE].load(memory_order_acquire))[id % BLOCK_SIZE]; }
+};
+
+// The pools live for the whole process, like the records that use them.
+// Room types are few and fixed; guest names come and go.
+InternPool& roomTypeNames() {
+    static InternPool* pool = new InternPool(size_t(1) << 16, false);
+    return *pool;
+}
+
+InternPool& guestNames() {
+    static InternPool* pool = new InternPool(size_t(1) << 26, true);
+    return *pool;
+}
+
+// A string field held as an id into one of the pools above. With Counted
+// (for a counted pool) each value holds its id in the pool, so the pool
+// can reuse the id once no value has it any more; otherwise copying one
+// is copying the id.
+template <typename Id, InternPool& (*Pool)(), bool Counted>
+class InternedString {
+public:
+    InternedString() = default;
+    InternedString(string_view text) : id(static_cast<Id>(Pool().intern(text))) {}
+    InternedString(const string& text) : InternedString(string_view(text)) {}
+    InternedString(const char* text) : InternedString(string_view(text)) {}
+    InternedString(const InternedString& other) : id(other.id) { hold(id); }
+    InternedString(InternedString&& other) noexcept : id(other.id) {
+        if constexpr (Counted) other.id = 0;
+    }
+    ~InternedString() { release(id); }
+
+    InternedString& operator=(const InternedString& other) {
+        hold(other.id);
+        release(id);
+        id = other.id;
+        return *this;
+    }
+
+    InternedString& operator=(InternedString&& other) noexcept {
+        swap(id, other.id);
+        return *this;
+    }
+
+    const string& str() const { return Pool().text(id); }
+    operator const string&() const { return str(); }
+    bool empty() const { return id == 0; }
+
+    // Equal for equal text, so it can key an index in place of the text
+    Id index() const { return id; }
+
+    // Index of text if some record uses it, without interning it
+    static bool lookup(string_view text, Id& found) {
+        uint32_t pooled;
+        if (!Pool().find(text, pooled)) return false;
+        found = static_cast<Id>(pooled);
+        return true;
+    }
+
+    friend bool operator==(const InternedString& a, const InternedString& b) { return a.id == b.id; }
+    friend bool operator!=(const InternedString& a, const InternedString& b) { return a.id != b.id; }
+    friend bool operator==(const InternedString& a, const string& b) { return a.str() == b; }
+    friend bool operator!=(const InternedString& a, const string& b) { return a.str() != b; }
+    friend bool operator==(const InternedString& a, const char* b) { return a.str() == b; }
+    friend bool operator!=(const InternedString& a, const char* b) { return a.str() != b; }
+    friend ostream& operator<<(ostream& out, const InternedString& s) { return out << s.str(); }
+
+private:
+    Id id = 0;
+
+    static void hold(Id held) {
+        if constexpr (Counted)
+            if (held != 0) Pool().hold(held);
+    }
+    static void release(Id held) {
+        if constexpr (Counted)
+            if (held != 0) Pool().release(held);
+    }
+};
+
+using RoomType = InternedString<uint16_t, roomTypeNames, false>;
+using GuestName = InternedString<uint32_t, guestNames, true>;
+
+// Rounds an amount to whole cents the way printing it with two decimals
+// does, so that an amount read back in cents is written out unchanged
+int64_t toCents(double amount) {
+    double scaled = amount * 100.0;
+    if (!(fabs(scaled) < 9e18)) throw out_of_range("amount out of range");
+    double whole = floor(scaled);
+    double fraction = scaled - whole;
+    if (fabs(fraction - 0.5) > 1e-6) return static_cast<int64_t>(fraction < 0.5 ? whole : whole + 1);
+
+    // Close to half a cent only the decimal expansion can tell which way it goes
+    char buf[64];
+    int n = snprintf(buf, sizeof buf, "%.2f", amount);
+    string digits(buf, static_cast<size_t>(max(n, 0)));
+    digits.erase(remove(digits.begin(), digits.end(), '.'), digits.end());
+    int64_t cents = 0;
+    from_chars(digits.data(), digits.data() + digits.size(), cents);
+    return cents;
+}
+
+// Formats whole cents as an amount with two decimals
+string formatCents(int64_t cents) {
+    uint64_t magnitude = cents < 0 ? 0 - static_cast<uint64_t>(cents) : static_cast<uint64_t>(cents);
+    string fraction = to_string(magnitude % 100);
+    return (cents < 0 ? "-" : "") + to_string(magnitude / 100) + (fraction.size() < 2 ? ".0" : ".") + fraction;
+}
+
+// An amount of money in whole cents. It converts to and from double, so
+// prices still take part in ordinary arithmetic and printing.
+class Money {
+public:
+    Money() = default;
+    Money(double amount) : value(toCents(amount)) {}
+
+    static Money fromCents(int64_t cents) {
+        Money m;
+        m.value = cents;
+        return m;
+    }
+
+    int64_t cents() const { return value; }
+    operator double() const { return static_cast<double>(value) / 100.0; }
+
+private:
+    int64_t value = 0;
+};
+
+// Any reference ID that is not in generateReferenceID()'s REF<number> form
+InternPool& referenceTexts() {
+    static InternPool* pool = new InternPool(size_t(1) << 26, true);
+    return *pool;
+}
+
+// A booking's reference ID. REF<number>, which confirming a booking
+// issues, is held as the number, and GRP<number>, which the bookings of a
+// group share, as the number with bit 62 set; any other text is interned
+// and held as its id with the top bit set. 0 means the booking is not
+// confirmed.
+class ReferenceId {
+public:
+    ReferenceId() = default;
+    ReferenceId(string_view text) : value(encode(text, true)) {}
+    ReferenceId(const string& text) : ReferenceId(string_view(text)) {}
+    ReferenceId(const char* text) : ReferenceId(string_view(text)) {}
+    ReferenceId(const ReferenceId& other) : value(other.value) { hold(value); }
+    ReferenceId(ReferenceId&& other) noexcept : value(other.value) { other.value = 0; }
+    ~ReferenceId() { release(value); }
+
+    ReferenceId& operator=(const ReferenceId& other) {
+        hold(other.value);
+        release(value);
+        value = other.value;
+        return *this;
+    }
+
+    ReferenceId& operator=(ReferenceId&& other) noexcept {
+        swap(value, other.value);
+        return *this;
+    }
+
+    string str() const {
+        if (value == 0) return "";
+        if (value & TEXT) return referenceTexts().text(static_cast<uint32_t>(value & ~TEXT));
+        if (value & GROUP) return "GRP" + to_string(value & ~GROUP);
+        return "REF" + to_string(value);
+    }
+
+    bool empty() const { return value == 0; }
+
+    // True for GRP<number>, the reference of a group booking
+    bool isGroup() const { return (value & (TEXT | GROUP)) == GROUP; }
+
+    // REF<number>, or no reference ID for 0. A key() without the top bit
+    // set gives back its reference ID, GRP<number> included.
+    static ReferenceId number(uint64_t n) {
+        ReferenceId id;
+        id.value = n & ~TEXT;
+        return id;
+    }
+
+    // Equal for equal text, so it can key an index in place of the text
+    uint64_t key() const { return value; }
+
+    // Key of text if some record may carry it, without interning it
+    static bool lookup(string_view text, uint64_t& found) {
+        found = encode(text, false);
+        return found != 0;
+    }
+
+    friend bool operator==(const ReferenceId& a, const ReferenceId& b) { return a.value == b.value; }
+    friend bool operator!=(const ReferenceId& a, const ReferenceId& b) { return a.value != b.value; }
+    friend ostream& operator<<(ostream& out, const ReferenceId& id) {
+        if (id.value & TEXT) return out << id.str();
+        if (id.value & GROUP) return out << "GRP" << (id.value & ~GROUP);
+        if (id.value != 0) out << "REF" << id.value;
+        return out;
+    }
+
+private:
+    static constexpr uint64_t TEXT = uint64_t(1) << 63;
+    static constexpr uint64_t GROUP = uint64_t(1) << 62;
+    uint64_t value = 0;
+
+    // Interned text is counted like an InternedString's
+    static void hold(uint64_t v) {
+        if (v & TEXT) referenceTexts().hold(static_cast<uint32_t>(v & ~TEXT));
+    }
+    static void release(uint64_t v) {
+        if (v & TEXT) referenceTexts().release(static_cast<uint32_t>(v & ~TEXT));
+    }
+
+    // 0 for "", and for text never interned when add is false
+    static uint64_t encode(string_view text, bool add) {
+        if (text.empty()) return 0;
+        bool group = text.compare(0, 3, "GRP") == 0;
+        if (text.size() > 3 && text.size() <= 21 && (group || text.compare(0, 3, "REF") == 0) && text[3] != '0') {
+            uint64_t number;
+            const char* end = text.data() + text.size();
+            auto result = from_chars(text.data() + 3, end, number);
+            if (result.ec == errc() && result.ptr == end && number < GROUP)
+                return group ? GROUP | number : number;
+        }
+        uint32_t id;
+        if (add) id = referenceTexts().intern(text);
+        else if (!referenceTexts().find(text, id)) return 0;
+        return TEXT | id;
+    }
+};
+
 // Represents a hotel room with number, type, price, and availability
 struct Room {
     int roomNumber;         // Unique identifier for the room
-    string roomType;       // Type of room (e.g., Single, Double, Suite)
-    double price;          // Price per night
+    RoomType roomType;     // Type of room (e.g., Single, Double, Suite)
+    Money price;           // Price per night
     bool isAvailable;      // Availability status
+    uint16_t property = 0; // Property the room belongs to; implied by the data directory, not stored in it
 
     // Serializes room data to a comma-separated string for file storage
     string serialize() const {
-        stringstream ss;
-        ss << roomNumber << "," << roomType << "," << fixed << setprecision(2) << price << "," << (isAvailable ? "1" : "0");
-        return ss.str();
+        return to_string(roomNumber) + "," + roomType.str() + "," + formatCents(price.cents()) + "," + (isAvailable ? "1" : "0");
     }
 
     // Deserializes a comma-separated string into a Room object
@@ -34,7 +670,7 @@ struct Room {
         string token;
 
         getline(ss, token, ','); r.roomNumber = stoi(token);
-        getline(ss, r.roomType, ',');
+        getline(ss, token, ','); r.roomType = token;
         getline(ss, token, ','); r.price = stod(token);
         getline(ss, token, ','); r.isAvailable = (token == "1");
 
@@ -44,17 +680,27 @@ struct Room {
 
 // Represents a booking with guest details, room, duration, cost, and reference ID
 struct Booking {
-    string guestName;      // Name of the guest making the booking
+    GuestName guestName;   // Name of the guest making the booking
     int roomNumber;       // Room number booked
     int nights;           // Number of nights for the stay
-    double totalCost;     // Total cost of the booking
-    string referenceID;   // Unique reference ID for confirmed bookings
+    Money totalCost;      // Total cost of the booking
+    ReferenceId referenceID; // Unique reference ID for confirmed bookings
+    int checkIn = NO_DATE; // Day number of the first night, or NO_DATE for legacy bookings
+    uint16_t property = 0; // Property of the booked room; implied by the data directory, not stored in it
+
+    // Day number the guest leaves (the stay covers [checkIn, checkOut))
+    int checkOut() const { return checkIn + nights; }
+
+    bool isDated() const { return checkIn != NO_DATE; }
 
-    // Serializes booking data to a comma-separated string for file storage
+    // Serializes booking data to a comma-separated string for file storage.
+    // The check-in date is appended only for dated bookings, so legacy
+    // lines are written back unchanged.
     string serialize() const {
-        stringstream ss;
-        ss << guestName << "," << roomNumber << "," << nights << "," << fixed << setprecision(2) << totalCost << "," << referenceID;
-        return ss.str();
+        string line = guestName.str() + "," + to_string(roomNumber) + "," + to_string(nights) + "," +
+                      formatCents(totalCost.cents()) + "," + referenceID.str();
+        if (isDated()) line += "," + formatDate(checkIn);
+        return line;
     }
 
     // Deserializes a comma-separated string into a Booking object
@@ -64,11 +710,13 @@ struct Booking {
             stringstream ss(line);
             string token;
 
-            getline(ss, b.guestName, ',');
+            getline(ss, token, ','); b.guestName = token;
             getline(ss, token, ','); b.roomNumber = stoi(token);
             getline(ss, token, ','); b.nights = stoi(token);
             getline(ss, token, ','); b.totalCost = stod(token);
-            getline(ss, b.referenceID, ',');
+            token.clear();
+            getline(ss, token, ','); b.referenceID = token;
+            if (getline(ss, token, ',') && !parseDate(token, b.checkIn)) throw runtime_error("invalid check-in date");
         } catch (const exception& e) {
             throw runtime_error("Booking deserialization failed: " + string(e.what()));
         }
@@ -76,738 +724,6141 @@ struct Booking {
     }
 };
 
+// Describes a booking's dates for listings; empty for legacy bookings
+string describeStay(const Booking& b) {
+    if (!b.isDated()) return "";
+    return ", Check-in: " + formatDate(b.checkIn) + ", Check-out: " + formatDate(b.checkOut());
+}
+
+// ----------------- Reference IDs -----------------
+
+// Flushes a file's contents to disk
+void syncFile(const string& path) {
+    STATS_TIME("syncFile");
+    int fd = ::open(path.c_str(), O_RDONLY);
+    bool synced = fd >= 0 && ::fsync(fd) == 0;
+    if (fd >= 0) ::close(fd);
+    if (!synced) throw runtime_error("Unable to sync " + path);
+}
+
+// Flushes the directory holding path, so a file created or renamed there survives a crash
+void syncDirectoryOf(const string& path) {
+    string dir = filesystem::path(path).parent_path().string();
+    syncFile(dir.empty() ? "." : dir);
+}
+
+// Hands out booking reference numbers from blocks reserved on disk.
+// ref_counter.txt holds the highest number reserved by any process. A
+// reservation takes an exclusive lock, bumps the counter by a whole block
+// and replaces the file atomically; numbers inside the block are then
+// issued from memory. A crash only leaves a gap, never a duplicate.
+class ReferenceIdAllocator {
+public:
+    explicit ReferenceIdAllocator(const string& counterPath = "ref_counter.txt", long long blockSize = 1000)
+        : path(counterPath), block(blockSize) {}
+
+    // Returns the next unused reference number
+    long long next() {
+        lock_guard<mutex> guard(lock);
+        if (nextId > blockEnd) reserveBlock();
+        return nextId++;
+    }
+
+    // Reserves count numbers on disk for a caller that issues them itself
+    // and returns the first of them
+    long long reserve(long long count) { return reserveOnDisk(count); }
+
+private:
+    string path;
+    long long block;
+    long long nextId = 1; // Next number to issue
+    long long blockEnd = 0; // Last number of the current block
+    mutex lock;
+
+    void reserveBlock() {
+        nextId = reserveOnDisk(block);
+        blockEnd = nextId + block - 1;
+    }
+
+    long long reserveOnDisk(long long count) {
+        string lockPath = path + ".lock";
+        int lockFd = ::open(lockPath.c_str(), O_RDWR | O_CREAT, 0644);
+        if (lockFd < 0) throw runtime_error("Unable to open " + lockPath);
+        if (flock(lockFd, LOCK_EX) != 0) {
+            ::close(lockFd);
+            throw runtime_error("Unable to lock " + lockPath);
+        }
+
+        try {
+            // The counter holds the last number reserved; without one,
+            // numbering starts at REF1000
+            long long reserved = 999;
+            ifstream in(path);
+            if (in.is_open()) {
+                if (!(in >> reserved) || reserved < 0 || !(in >> ws).eof())
+                    throw runtime_error("Corrupt reference counter in " + path);
+            } else if (filesystem::exists(path)) {
+                throw runtime_error("Unable to read " + path);
+            }
+            in.close();
+
+            // Write the new high-water mark to a temporary file, sync it and
+            // rename it over the counter so readers see the old or new value
+            string tmp = path + ".tmp";
+            string text = to_string(reserved + count);
+            int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (fd < 0) throw runtime_error("Unable to open " + tmp);
+            bool written = ::write(fd, text.data(), text.size()) == static_cast<ssize_t>(text.size()) && ::fsync(fd) == 0;
+            ::close(fd);
+            if (!written || ::rename(tmp.c_str(), path.c_str()) != 0)
+                throw runtime_error("Unable to update " + path);
+            syncDirectoryOf(path); // The rename itself must survive a crash
+            flock(lockFd, LOCK_UN);
+            ::close(lockFd);
+            return reserved + 1;
+        } catch (...) {
+            flock(lockFd, LOCK_UN);
+            ::close(lockFd);
+            throw;
+        }
+    }
+};
+
+// The allocator behind booking and group reference IDs, which share one
+// sequence so that no number is ever both a REF and a GRP
+ReferenceIdAllocator& referenceIdAllocator() {
+    static ReferenceIdAllocator allocator;
+    return allocator;
+}
+
 // Generates a unique reference ID for confirmed bookings
 string generateReferenceID() {
-    int refNum = 1000; // Starting reference number
-    ifstream in("ref_counter.txt");
-    if (in >> refNum) refNum++; // Increment if file exists and contains a number
-    in.close();
+    STATS_TIME("generateReferenceID");
+    return "REF" + to_string(referenceIdAllocator().next()); // Return formatted reference ID
+}
+
+// Generates a unique reference ID covering every booking of a group
+string generateGroupReferenceID() {
+    return "GRP" + to_string(referenceIdAllocator().next());
+}
+
+// Accepts a booking or group reference ID typed in any case ("ref1001",
+// "grp1002") and rewrites it the way it is issued; returns false if text
+// is not one
+bool normalizeReferenceID(string& text) {
+    if (text.size() < 4) return false;
+    bool group = strncasecmp(text.c_str(), "GRP", 3) == 0;
+    if (!group && strncasecmp(text.c_str(), "REF", 3) != 0) return false;
+    if (!all_of(text.begin() + 3, text.end(), [](unsigned char c) { return isdigit(c); })) return false;
+    text.replace(0, 3, group ? "GRP" : "REF");
+    return true;
+}
+
+// True if a reference ID as normalizeReferenceID() leaves it names a group
+bool isGroupReferenceID(const string& text) { return text.compare(0, 3, "GRP") == 0; }
+
+// ----------------- Fast Parsing -----------------
+
+// Read-only memory mapping of a whole file
+class MappedFile {
+public:
+    explicit MappedFile(const string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) throw runtime_error("Unable to open " + path);
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            ::close(fd);
+            throw runtime_error("Unable to stat " + path);
+        }
+        length = static_cast<size_t>(st.st_size);
+        if (length > 0) {
+            void* mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped == MAP_FAILED) {
+                ::close(fd);
+                throw runtime_error("Unable to map " + path);
+            }
+            data = static_cast<const char*>(mapped);
+        }
+        ::close(fd);
+    }
+
+    ~MappedFile() {
+        if (data) munmap(const_cast<char*>(data), length);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    string_view view() const { return string_view(data, length); }
+
+private:
+    const char* data = nullptr;
+    size_t length = 0;
+};
+
+// Calls fn(line, lineNumber) for every non-empty line, without copying.
+// A trailing '\r' from CRLF files is stripped.
+template <typename Fn>
+void forEachLine(string_view text, Fn fn) {
+    size_t lineNo = 0;
+    while (!text.empty()) {
+        ++lineNo;
+        const char* nl = static_cast<const char*>(memchr(text.data(), '\n', text.size()));
+        size_t len = nl ? static_cast<size_t>(nl - text.data()) : text.size();
+        string_view line = text.substr(0, len);
+        text.remove_prefix(nl ? len + 1 : len);
+
+        if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+        if (!line.empty()) fn(line, lineNo);
+    }
+}
+
+// Walks the comma-separated fields of one line as views into the line
+struct FieldCursor {
+    string_view rest;
+    bool exhausted = false;
+
+    // Stores the next field in field; returns false when none is left
+    bool next(string_view& field) {
+        if (exhausted) return false;
+        size_t comma = rest.find(',');
+        if (comma == string_view::npos) {
+            field = rest;
+            exhausted = true;
+        } else {
+            field = rest.substr(0, comma);
+            rest.remove_prefix(comma + 1);
+        }
+        return true;
+    }
+};
+
+// Parses a whole field as a number; returns false on junk or overflow
+template <typename T>
+bool parseNumber(string_view field, T& out) {
+    const char* end = field.data() + field.size();
+    auto result = from_chars(field.data(), end, out);
+    return result.ec == errc() && result.ptr == end;
+}
+
+// Parses an amount as the data files write it. Amounts with at most two
+// decimals, which is all this program writes, are read digit by digit
+// into cents; anything else is read as a double and rounded as it prints.
+bool parseMoney(string_view field, Money& out) {
+    size_t dot = field.find('.');
+    string_view units = field.substr(0, dot), fraction = dot == string_view::npos ? string_view() : field.substr(dot + 1);
+    bool negative = !units.empty() && units[0] == '-';
+    if (negative) units.remove_prefix(1);
+    auto allDigits = [](string_view digits) {
+        return all_of(digits.begin(), digits.end(), [](unsigned char c) { return isdigit(c); });
+    };
+    if (!units.empty() && units.size() <= 15 && fraction.size() <= 2 && allDigits(units) && allDigits(fraction) &&
+        (dot == string_view::npos || !fraction.empty())) {
+        int64_t cents = 0;
+        for (char c : units) cents = cents * 10 + (c - '0');
+        for (size_t i = 0; i < 2; ++i) cents = cents * 10 + (i < fraction.size() ? fraction[i] - '0' : 0);
+        out = Money::fromCents(negative ? -cents : cents);
+        return true;
+    }
+
+    double amount;
+    if (!parseNumber(field, amount) || !(fabs(amount) < 1e15)) return false;
+    out = Money(amount);
+    return true;
+}
 
-    ofstream out("ref_counter.txt");
-    out << refNum; // Save updated number
-    out.close();
+// Parses one rooms.txt line into r.
+// Returns nullptr on success or a description of what is wrong.
+const char* parseRoomLine(string_view line, Room& r) {
+    FieldCursor fields{line};
+    string_view f;
+    if (!fields.next(f) || !parseNumber(f, r.roomNumber)) return "invalid room number";
+    if (!fields.next(f)) return "missing room type";
+    r.roomType = f;
+    if (!fields.next(f) || !parseMoney(f, r.price)) return "invalid price";
+    r.isAvailable = fields.next(f) && f == "1";
+    return nullptr;
+}
 
-    return "REF" + to_string(refNum); // Return formatted reference ID
+// Parses one bookings.txt line into b.
+// Returns nullptr on success or a description of what is wrong.
+const char* parseBookingLine(string_view line, Booking& b) {
+    FieldCursor fields{line};
+    string_view f;
+    if (!fields.next(f)) return "missing guest name";
+    b.guestName = f;
+    if (!fields.next(f) || !parseNumber(f, b.roomNumber)) return "invalid room number";
+    if (!fields.next(f) || !parseNumber(f, b.nights)) return "invalid nights";
+    if (!fields.next(f) || !parseMoney(f, b.totalCost)) return "invalid total cost";
+    b.referenceID = fields.next(f) ? ReferenceId(f) : ReferenceId();
+    b.checkIn = NO_DATE;
+    if (fields.next(f) && !parseDate(f, b.checkIn)) return "invalid check-in date";
+    return nullptr;
 }
 
 // ----------------- File I/O -----------------
 
+// Path of a data file kept in directory, or in the working directory if
+// directory is empty
+string dataFile(const string& directory, const string& name) {
+    return directory.empty() ? name : directory + "/" + name;
+}
+
 // Loads all rooms from rooms.txt file
-vector<Room> loadRooms() {
+vector<Room> loadRooms(const string& path = "rooms.txt") {
+    STATS_TIME("loadRooms");
     vector<Room> rooms;
     try {
-        ifstream file("rooms.txt");
-        if (!file.is_open()) throw runtime_error("Unable to open rooms.txt");
+        MappedFile file(path);
+        string_view text = file.view();
+        STATS_COUNT("rooms.bytesRead", text.size());
+        rooms.reserve(count(text.begin(), text.end(), '\n') + 1);
 
-        string line;
-        while (getline(file, line)) {
-            if (!line.empty()) {
-                try {
-                    rooms.push_back(Room::deserialize(line));
-                } catch (const exception& e) {
-                    cerr << "Error parsing room data: " << e.what() << " (line: " << line << ")\n";
-                }
+        Room r;
+        forEachLine(text, [&](string_view line, size_t lineNo) {
+            if (const char* error = parseRoomLine(line, r)) {
+                STATS_COUNT("rooms.parseErrors", 1);
+                cerr << "Error parsing room data: " << error << " (line " << lineNo << ": " << line << ")\n";
+            } else {
+                rooms.push_back(r);
             }
-        }
+        });
+        STATS_COUNT("rooms.recordsParsed", rooms.size());
     } catch (const exception& e) {
         cerr << "Exception in loadRooms(): " << e.what() << "\n";
     }
     return rooms;
 }
 
-// Saves all rooms to rooms.txt file
-void saveRooms(const vector<Room>& rooms) {
-    ofstream file("rooms.txt");
-    for (const auto& r : rooms) file << r.serialize() << "\n";
+// How far a change is written before it is acknowledged
+enum class Durability {
+    None,   // Handed to the OS; a power cut can lose the last changes
+    Strict, // Synced to disk before the change is acknowledged
+    Group   // Synced too, but changes arriving within a short window share one sync
+};
+
+// Parses none/strict/group
+Durability parseDurability(const string& text) {
+    if (text == "none") return Durability::None;
+    if (text == "strict") return Durability::Strict;
+    if (text == "group") return Durability::Group;
+    throw runtime_error("Unknown durability: " + text + " (expected none, strict or group)");
+}
+
+const char* durabilityName(Durability level) {
+    switch (level) {
+        case Durability::Strict: return "strict";
+        case Durability::Group: return "group";
+        default: return "none";
+    }
+}
+
+// Writes a file through a temporary copy that is renamed into place, so a
+// crash part-way through never leaves a truncated data file behind. With
+// sync set the copy reaches the disk before the rename, and the rename
+// before returning. Returns the number of bytes written.
+template <typename Writer>
+size_t writeFileAtomically(const string& path, Writer write, bool sync = false) {
+    string tmp = path + "." + to_string(getpid()) + ".tmp"; // Unique per process sharing the directory
+    size_t written;
+    {
+        ofstream file(tmp, ios::trunc | ios::binary);
+        if (!file) throw runtime_error("Unable to open " + tmp + " for writing");
+        write(file);
+        if (!file.flush()) throw runtime_error("Failed writing " + tmp);
+        written = static_cast<size_t>(file.tellp());
+    }
+    if (sync) syncFile(tmp);
+    if (rename(tmp.c_str(), path.c_str()) != 0) throw runtime_error("Unable to replace " + path);
+    if (sync) syncDirectoryOf(path);
+    return written;
+}
+
+// Saves all rooms to rooms.txt file, synced to disk if sync is set
+void saveRooms(const vector<Room>& rooms, bool sync = false, const string& path = "rooms.txt") {
+    STATS_TIME("saveRooms");
+    size_t written = writeFileAtomically(path, [&](ostream& file) {
+        for (const auto& r : rooms) file << r.serialize() << "\n";
+    }, sync);
+    STATS_COUNT("rooms.bytesWritten", written);
 }
 
 // Loads all bookings from bookings.txt file
-vector<Booking> loadBookings() {
+vector<Booking> loadBookings(const string& path = "bookings.txt") {
+    STATS_TIME("loadBookings");
     vector<Booking> bookings;
     try {
-        ifstream file("bookings.txt");
-        if (!file.is_open()) throw runtime_error("Unable to open bookings.txt");
+        MappedFile file(path);
+        string_view text = file.view();
+        STATS_COUNT("bookings.bytesRead", text.size());
+        bookings.reserve(count(text.begin(), text.end(), '\n') + 1);
 
-        string line;
-        while (getline(file, line)) {
-            if (!line.empty()) {
-                try {
-                    bookings.push_back(Booking::deserialize(line));
-                } catch (const exception& e) {
-                    cerr << "Error parsing booking data: " << e.what() << " (line: " << line << ")\n";
-                }
+        Booking b;
+        forEachLine(text, [&](string_view line, size_t lineNo) {
+            if (const char* error = parseBookingLine(line, b)) {
+                STATS_COUNT("bookings.parseErrors", 1);
+                cerr << "Error parsing booking data: " << error << " (line " << lineNo << ": " << line << ")\n";
+            } else {
+                bookings.push_back(b);
             }
-        }
+        });
+        STATS_COUNT("bookings.recordsParsed", bookings.size());
     } catch (const exception& e) {
         cerr << "Exception in loadBookings(): " << e.what() << "\n";
     }
     return bookings;
 }
 
-// Saves all bookings to bookings.txt file
-void saveBookings(const vector<Booking>& bookings) {
-    ofstream file("bookings.txt");
-    for (const auto& b : bookings) file << b.serialize() << "\n";
+// Saves all bookings to bookings.txt file, synced to disk if sync is set
+void saveBookings(const vector<Booking>& bookings, bool sync = false, const string& path = "bookings.txt") {
+    STATS_TIME("saveBookings");
+    size_t written = writeFileAtomically(path, [&](ostream& file) {
+        for (const auto& b : bookings) file << b.serialize() << "\n";
+    }, sync);
+    STATS_COUNT("bookings.bytesWritten", written);
 }
 
-// ----------------- Pricing Strategy -----------------
+// ----------------- Binary Snapshot -----------------
 
-// Abstract base class for pricing strategies (Strategy Design Pattern)
-class PricingStrategy {
-public:
-    // Pure virtual function to calculate price based on number of nights
-    virtual double calculate(int nights) = 0;
-    virtual ~PricingStrategy() = default; // Virtual destructor for proper cleanup
+const char* const SNAPSHOT_FILE = "hotel.snap";
+const uint32_t SNAPSHOT_VERSION = 4; // 2: bookings carry a check-in date; 3: money in cents; 4: source file identity
+
+// One version of a file. Size and modification time alone miss a rewrite
+// of the same size within one clock tick; every save replaces a data file
+// through a rename, so the inode (and device) tells such rewrites apart.
+struct FileStamp {
+    int64_t size = -1, time = -1; // -1 if the file is missing
+    uint64_t device = 0, inode = 0;
+
+    bool exists() const { return size >= 0; }
+    bool operator==(const FileStamp& other) const {
+        return size == other.size && time == other.time && device == other.device && inode == other.inode;
+    }
+    bool operator!=(const FileStamp& other) const { return !(*this == other); }
 };
 
-// Pricing strategy for Single rooms
-class SingleRoomPricing : public PricingStrategy {
-public:
-    // Calculates price as $100 per night
-    double calculate(int nights) override { return nights * 100; }
+// Stamp of a regular file, or a missing one's
+FileStamp fileStamp(const string& path) {
+    struct stat st;
+    if (::stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) return {};
+    return {static_cast<int64_t>(st.st_size), static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec,
+            static_cast<uint64_t>(st.st_dev), static_cast<uint64_t>(st.st_ino)};
+}
+
+// Optional binary image of the full room and booking state, written next
+// to the text files. It records the stamps (size, modification time,
+// device and inode) of rooms.txt/bookings.txt as they were when it was
+// written, and is only trusted while both still match, so editing or
+// restoring the CSV files always wins over a stale snapshot, even within
+// one mtime tick.
+//
+// Layout: header, fixed-width room records, fixed-width booking records,
+// string offsets (stringCount + 1 entries), then the string bytes.
+// Guest names and room types are stored once in the string table and
+// referenced by index; string 0 is always "". Reference IDs are stored as
+// their number, or as a string index with the top bit set if they are not
+// of the REF<number> form.
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t roomCount;
+    uint64_t bookingCount;
+    uint64_t stringCount;
+    uint64_t stringBytes;
+    FileStamp roomsFile;    // rooms.txt when the snapshot was written
+    FileStamp bookingsFile; // bookings.txt when the snapshot was written
 };
 
-// Pricing strategy for Double rooms
-class DoubleRoomPricing : public PricingStrategy {
-public:
-    // Calculates price as $150 per night
-    // Note: Inconsistent with Admin::addRoom ($180)
-    double calculate(int nights) override { return nights * 150; }
+struct SnapshotRoom {
+    int32_t roomNumber;
+    uint32_t roomType;  // String table index
+    int64_t priceCents;
+    uint8_t isAvailable;
+    uint8_t padding[7];
 };
 
-// Pricing strategy for Suite rooms
-class SuiteRoomPricing : public PricingStrategy {
-public:
-    // Calculates price as $250 per night
-    // Note: Inconsistent with Admin::addRoom ($300)
-    double calculate(int nights) override { return nights * 250; }
+struct SnapshotBooking {
+    uint32_t guestName;   // String table index
+    int32_t roomNumber;
+    int32_t nights;
+    int32_t checkIn;      // NO_DATE for legacy bookings
+    int64_t totalCents;
+    uint64_t referenceID;
 };
 
-// Selects appropriate pricing strategy based on room type and calculates cost
-double calculatePrice(const string& type, int nights) {
-    PricingStrategy* strategy = nullptr;
-    if (type == "Single") strategy = new SingleRoomPricing();
-    else if (type == "Double") strategy = new DoubleRoomPricing();
-    else if (type == "Suite") strategy = new SuiteRoomPricing();
-    else strategy = new SingleRoomPricing(); // Fallback to Single pricing
+const char SNAPSHOT_MAGIC[8] = {'H', 'T', 'L', 'S', 'N', 'A', 'P', '\0'};
 
-    double cost = strategy->calculate(nights);
-    delete strategy; // Clean up to prevent memory leak
-    return cost;
+// Writes hotel.snap in directory (default: the working directory) for the
+// given state; call after the text files are saved
+void saveSnapshot(const vector<Room>& rooms, const vector<Booking>& bookings, const string& directory = "") {
+    vector<string_view> strings{""};
+    unordered_map<string_view, uint32_t> stringIds{{"", 0}};
+    auto intern = [&](string_view text) {
+        auto found = stringIds.emplace(text, static_cast<uint32_t>(strings.size()));
+        if (found.second) strings.push_back(text);
+        return found.first->second;
+    };
+    const uint64_t TEXT_REFERENCE = uint64_t(1) << 63;
+    deque<string> referenceTexts; // Keeps the odd reference IDs alive while they are in strings
+    auto reference = [&](ReferenceId id) -> uint64_t {
+        if (!(id.key() & TEXT_REFERENCE)) return id.key();
+        referenceTexts.push_back(id.str());
+        return TEXT_REFERENCE | intern(referenceTexts.back());
+    };
+
+    vector<SnapshotRoom> roomRecords;
+    roomRecords.reserve(rooms.size());
+    for (const auto& r : rooms)
+        roomRecords.push_back({r.roomNumber, intern(r.roomType.str()), r.price.cents(), r.isAvailable, {}});
+
+    vector<SnapshotBooking> bookingRecords;
+    bookingRecords.reserve(bookings.size());
+    for (const auto& b : bookings)
+        bookingRecords.push_back({intern(b.guestName.str()), b.roomNumber, b.nights, b.checkIn, b.totalCost.cents(), reference(b.referenceID)});
+
+    vector<uint64_t> offsets{0};
+    for (auto text : strings) offsets.push_back(offsets.back() + text.size());
+
+    SnapshotHeader header{};
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof header.magic);
+    header.version = SNAPSHOT_VERSION;
+    header.roomCount = static_cast<uint32_t>(roomRecords.size());
+    header.bookingCount = bookingRecords.size();
+    header.stringCount = strings.size();
+    header.stringBytes = offsets.back();
+    header.roomsFile = fileStamp(dataFile(directory, "rooms.txt"));
+    header.bookingsFile = fileStamp(dataFile(directory, "bookings.txt"));
+
+    writeFileAtomically(dataFile(directory, SNAPSHOT_FILE), [&](ostream& out) {
+        out.write(reinterpret_cast<const char*>(&header), sizeof header);
+        out.write(reinterpret_cast<const char*>(roomRecords.data()), roomRecords.size() * sizeof(SnapshotRoom));
+        out.write(reinterpret_cast<const char*>(bookingRecords.data()), bookingRecords.size() * sizeof(SnapshotBooking));
+        out.write(reinterpret_cast<const char*>(offsets.data()), offsets.size() * sizeof(uint64_t));
+        for (auto text : strings) out.write(text.data(), text.size());
+    });
 }
 
-// ----------------- User Base Class -----------------
+// Maps directory's hotel.snap and rebuilds rooms and bookings from it.
+// Returns false, leaving the vectors untouched, if the snapshot is missing,
+// corrupt, from another version, or older than the text files.
+bool loadSnapshot(vector<Room>& rooms, vector<Booking>& bookings, const string& directory = "") {
+    string path = dataFile(directory, SNAPSHOT_FILE);
+    if (!fileStamp(path).exists()) return false;
+    try {
+        MappedFile file(path);
+        string_view data = file.view();
 
-// Abstract base class for users (Guest or Admin)
+        SnapshotHeader header;
+        if (data.size() < sizeof header) return false;
+        memcpy(&header, data.data(), sizeof header);
+        if (memcmp(header.magic, SNAPSHOT_MAGIC, sizeof header.magic) != 0 || header.version != SNAPSHOT_VERSION)
+            return false;
+        if (fileStamp(dataFile(directory, "rooms.txt")) != header.roomsFile ||
+            fileStamp(dataFile(directory, "bookings.txt")) != header.bookingsFile)
+            return false;
+
+        // Each count is checked against the bytes left before it is
+        // multiplied, so a corrupt header cannot wrap the offsets around
+        size_t left = data.size() - sizeof header;
+        if (header.roomCount > left / sizeof(SnapshotRoom)) return false;
+        left -= header.roomCount * sizeof(SnapshotRoom);
+        if (header.bookingCount > left / sizeof(SnapshotBooking)) return false;
+        left -= header.bookingCount * sizeof(SnapshotBooking);
+        if (header.stringCount == 0 || header.stringCount >= left / sizeof(uint64_t)) return false;
+        left -= (header.stringCount + 1) * sizeof(uint64_t);
+        if (header.stringBytes != left) return false;
+
+        size_t roomsAt = sizeof header;
+        size_t bookingsAt = roomsAt + header.roomCount * sizeof(SnapshotRoom);
+        size_t offsetsAt = bookingsAt + header.bookingCount * sizeof(SnapshotBooking);
+        size_t stringsAt = offsetsAt + (header.stringCount + 1) * sizeof(uint64_t);
+
+        // The mapping is page aligned and every section is a multiple of 8
+        // bytes, so the records can be read in place
+        auto roomRecords = reinterpret_cast<const SnapshotRoom*>(data.data() + roomsAt);
+        auto bookingRecords = reinterpret_cast<const SnapshotBooking*>(data.data() + bookingsAt);
+        auto offsets = reinterpret_cast<const uint64_t*>(data.data() + offsetsAt);
+        const char* stringBytes = data.data() + stringsAt;
+
+        for (uint64_t i = 0; i < header.stringCount; ++i)
+            if (offsets[i] > offsets[i + 1] || offsets[i + 1] > header.stringBytes) return false;
+        auto text = [&](uint64_t id) {
+            if (id >= header.stringCount) throw runtime_error("string index out of range");
+            return string_view(stringBytes + offsets[id], offsets[id + 1] - offsets[id]);
+        };
+        const uint64_t TEXT_REFERENCE = uint64_t(1) << 63;
+        auto reference = [&](uint64_t id) {
+            if (id & TEXT_REFERENCE) return ReferenceId(text(id & ~TEXT_REFERENCE));
+            return ReferenceId::number(id);
+        };
+
+        // Each distinct string is interned once, not once per record
+        vector<RoomType> types(header.stringCount);
+        vector<GuestName> guests(header.stringCount);
+        vector<bool> typeSeen(header.stringCount), guestSeen(header.stringCount);
+        auto roomType = [&](uint32_t id) {
+            if (!typeSeen.at(id)) types[id] = text(id), typeSeen[id] = true;
+            return types[id];
+        };
+        auto guest = [&](uint32_t id) {
+            if (!guestSeen.at(id)) guests[id] = text(id), guestSeen[id] = true;
+            return guests[id];
+        };
+
+        vector<Room> loadedRooms;
+        loadedRooms.reserve(header.roomCount);
+        for (uint32_t i = 0; i < header.roomCount; ++i) {
+            const auto& r = roomRecords[i];
+            loadedRooms.push_back({r.roomNumber, roomType(r.roomType), Money::fromCents(r.priceCents), r.isAvailable != 0});
+        }
+
+        vector<Booking> loadedBookings;
+        loadedBookings.reserve(header.bookingCount);
+        for (uint64_t i = 0; i < header.bookingCount; ++i) {
+            const auto& b = bookingRecords[i];
+            loadedBookings.push_back({guest(b.guestName), b.roomNumber, b.nights, Money::fromCents(b.totalCents),
+                                      reference(b.referenceID), b.checkIn});
+        }
+
+        rooms = move(loadedRooms);
+        bookings = move(loadedBookings);
+        return true;
+    } catch (const exception& e) {
+        cerr << "Ignoring unreadable " << path << ": " << e.what() << "\n";
+        return false;
+    }
+}
+
+// ----------------- Sharded Storage -----------------
+
+const char* const SHARD_DIR = "shards";
+const char* const SHARD_LAYOUT_FILE = "shards/layout.txt";
+
+// Where the rooms and bookings are kept. The single-file layout uses
+// rooms.txt and bookings.txt. The sharded layout partitions rooms by room
+// number, roomsPerShard numbers to a shard, and keeps each shard's rooms
+// and their bookings in a file pair of their own:
+// shards/<roomsPerShard>/rooms-<shard>.txt and bookings-<shard>.txt.
+// With the usual numbering (floor * 100 + room) 100 rooms per shard puts
+// every floor in a shard. shards/layout.txt names the sharded layout in
+// use; without it the directory is in the single-file layout. Each layout
+// writes under a directory of its own, so a migration can write the new
+// files in full before switching layout.txt over to them. All of these
+// paths are relative to the data directory, base.
+struct ShardLayout {
+    int roomsPerShard = 0; // 0 in the single-file layout
+    string base;           // The data directory; empty for the working directory
+
+    bool sharded() const { return roomsPerShard > 0; }
+
+    bool operator==(const ShardLayout& other) const { return roomsPerShard == other.roomsPerShard; }
+
+    int shardOf(int roomNumber) const {
+        int shard = roomNumber / roomsPerShard;
+        return roomNumber % roomsPerShard < 0 ? shard - 1 : shard; // Round down for negative numbers too
+    }
+
+    string file(const string& name) const { return dataFile(base, name); }
+    string directory() const { return file(SHARD_DIR) + "/" + to_string(roomsPerShard); }
+    string roomsPath(int shard) const { return directory() + "/rooms-" + to_string(shard) + ".txt"; }
+    string bookingsPath(int shard) const { return directory() + "/bookings-" + to_string(shard) + ".txt"; }
+
+    // Shards with at least one file on disk, in ascending order
+    vector<int> shardsOnDisk() const {
+        set<int> shards;
+        error_code ec;
+        for (const auto& entry : filesystem::directory_iterator(directory(), ec)) {
+            string name = entry.path().filename().string();
+            size_t dash = name.find('-');
+            int shard;
+            if (dash == string::npos || name.size() < dash + 5 || name.compare(name.size() - 4, 4, ".txt") != 0) continue;
+            if (parseNumber(string_view(name).substr(dash + 1, name.size() - dash - 5), shard)) shards.insert(shard);
+        }
+        return vector<int>(shards.begin(), shards.end());
+    }
+
+    string describe() const {
+        return sharded() ? to_string(roomsPerShard) + " room numbers per shard" : "single files";
+    }
+
+    // The layout the data directory base is in
+    static ShardLayout detect(const string& base = "") {
+        ShardLayout layout;
+        layout.base = base;
+        ifstream in(layout.file(SHARD_LAYOUT_FILE));
+        string line;
+        if (!in || !getline(in, line)) return layout;
+        if (line.rfind("roomsPerShard,", 0) != 0 || !parseNumber(string_view(line).substr(14), layout.roomsPerShard) ||
+            layout.roomsPerShard <= 0)
+            throw runtime_error("Malformed " + layout.file(SHARD_LAYOUT_FILE));
+        return layout;
+    }
+
+    // Parses a layout option: single, floor (100 room numbers per shard) or a number of room numbers per shard
+    static ShardLayout parse(const string& key) {
+        ShardLayout layout;
+        if (key == "single") return layout;
+        if (key == "floor") layout.roomsPerShard = 100;
+        else if (!parseNumber(key, layout.roomsPerShard) || layout.roomsPerShard <= 0)
+            throw runtime_error("Unknown layout: " + key + " (expected single, floor or a number of rooms per shard)");
+        return layout;
+    }
+};
+
+// Parses the files of the given shards, several shards at a time, and
+// returns each one's rooms and bookings in the order of shards
+vector<pair<vector<Room>, vector<Booking>>> loadShardFiles(const ShardLayout& layout, const vector<int>& shards) {
+    STATS_TIME("loadShardFiles");
+    vector<pair<vector<Room>, vector<Booking>>> loaded(shards.size());
+    atomic<size_t> next{0};
+    auto work = [&]() {
+        for (size_t i; (i = next++) < shards.size();) {
+            // A shard may have rooms but no bookings yet, or only bookings left
+            if (fileStamp(layout.roomsPath(shards[i])).exists()) loaded[i].first = loadRooms(layout.roomsPath(shards[i]));
+            if (fileStamp(layout.bookingsPath(shards[i])).exists()) loaded[i].second = loadBookings(layout.bookingsPath(shards[i]));
+        }
+    };
+    size_t threads = min<size_t>(shards.size(), max(1u, thread::hardware_concurrency()));
+    vector<thread> helpers;
+    for (size_t t = 1; t < threads; ++t) helpers.emplace_back(work);
+    work();
+    for (auto& helper : helpers) helper.join();
+    return loaded;
+}
+
+// Rewrites shard files from what forEachRoom(fn) and forEachBooking(fn)
+// enumerate: the rooms files of roomShards and the bookings files of
+// bookingShards, or, where those are null, every shard with data or with
+// a file on disk, so that a shard left empty is emptied on disk too
+template <typename RoomSource, typename BookingSource>
+void saveShards(const ShardLayout& layout, RoomSource forEachRoom, BookingSource forEachBooking,
+                const set<int>* roomShards, const set<int>* bookingShards, bool sync) {
+    STATS_TIME("saveShards");
+    filesystem::create_directories(layout.directory());
+    map<int, string> roomText, bookingText;
+    vector<int> onDisk = roomShards && bookingShards ? vector<int>() : layout.shardsOnDisk();
+    for (int shard : roomShards ? vector<int>(roomShards->begin(), roomShards->end()) : onDisk) roomText[shard];
+    for (int shard : bookingShards ? vector<int>(bookingShards->begin(), bookingShards->end()) : onDisk) bookingText[shard];
+
+    forEachRoom([&](const Room& r) {
+        int shard = layout.shardOf(r.roomNumber);
+        if (roomShards && !roomShards->count(shard)) return;
+        string& text = roomText[shard];
+        text += r.serialize();
+        text += '\n';
+    });
+    forEachBooking([&](const Booking& b) {
+        int shard = layout.shardOf(b.roomNumber);
+        if (bookingShards && !bookingShards->count(shard)) return;
+        string& text = bookingText[shard];
+        text += b.serialize();
+        text += '\n';
+    });
+
+    for (const auto& [shard, text] : roomText) {
+        size_t written = writeFileAtomically(layout.roomsPath(shard), [&](ostream& out) { out << text; }, sync);
+        STATS_COUNT("rooms.bytesWritten", written);
+    }
+    for (const auto& [shard, text] : bookingText) {
+        size_t written = writeFileAtomically(layout.bookingsPath(shard), [&](ostream& out) { out << text; }, sync);
+        STATS_COUNT("bookings.bytesWritten", written);
+    }
+}
+
+// ----------------- File Locking -----------------
+
+// Several copies of the program may share one data directory. They
+// coordinate through advisory byte-range locks on hotel.lock; each byte
+// below guards one resource, and rooms get a byte each so that updates to
+// different rooms never wait on one another.
+const char* const LOCK_FILE = "hotel.lock";
+const off_t LOCK_JOURNAL_ROTATION = 0; // Shared by writers, exclusive while the journal is rotated
+const off_t LOCK_JOURNAL_APPEND = 1;   // Held for the duration of a single journal write
+const off_t LOCK_DATA_FILES = 2;       // Shared by readers of rooms.txt/bookings.txt, exclusive by writers
+const off_t LOCK_FIRST_ROOM = 16;      // Room n is guarded by byte LOCK_FIRST_ROOM + n
+
+// Open handle on hotel.lock. POSIX record locks belong to the process and
+// are all dropped when any descriptor for the file is closed, so each
+// process keeps exactly one of these open. They do not tell the process's
+// threads apart either: a second lock on a byte the process already holds
+// replaces the first, and unlocking it releases both. So the threads of a
+// process queue for each byte among themselves first, as readers and
+// writers, and only the first holder in takes the record lock and the
+// last one out releases it.
+class LockFile {
+public:
+    explicit LockFile(const string& path) {
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd < 0) throw runtime_error("Unable to open " + path);
+    }
+
+    ~LockFile() { ::close(fd); }
+
+    LockFile(const LockFile&) = delete;
+    LockFile& operator=(const LockFile&) = delete;
+
+    // Blocks until the byte is locked, against other threads and other processes
+    void lock(off_t byte, bool exclusive) {
+        unique_lock<mutex> guard(holdersLock);
+        Holders& h = holders[byte]; // Elements keep their address when the map grows
+        ++h.waiting;
+        if (exclusive) ++h.writersWaiting;
+        // Waiting writers go first, or a stream of readers could starve them
+        h.ready.wait(guard, [&] {
+            return !h.acquiring && !h.writer && (exclusive ? h.readers == 0 : h.writersWaiting == 0);
+        });
+        --h.waiting;
+        if (exclusive) --h.writersWaiting;
+
+        if (h.readers == 0) {
+            // First holder in the process: wait for the other processes
+            // without blocking threads that are after other bytes
+            h.acquiring = true;
+            guard.unlock();
+            try {
+                set(byte, exclusive ? F_WRLCK : F_RDLCK);
+            } catch (...) {
+                guard.lock();
+                h.acquiring = false;
+                release(byte, h);
+                throw;
+            }
+            guard.lock();
+            h.acquiring = false;
+        }
+        if (exclusive) h.writer = true;
+        else ++h.readers;
+        h.ready.notify_all(); // Readers queued behind the acquisition
+    }
+
+    void unlock(off_t byte) {
+        lock_guard<mutex> guard(holdersLock);
+        Holders& h = holders[byte];
+        if (h.writer) h.writer = false;
+        else --h.readers;
+        if (!h.writer && h.readers == 0) set(byte, F_UNLCK);
+        release(byte, h);
+    }
+
+    // The file's first eight bytes count journal rotations. Locks do not
+    // care what the bytes hold, so the counter lives alongside them; it is
+    // read under the rotation lock and written only while that is exclusive.
+    uint64_t generation() const {
+        uint64_t value = 0;
+        if (pread(fd, &value, sizeof value, 0) != static_cast<ssize_t>(sizeof value)) return 0;
+        return value;
+    }
+
+    void setGeneration(uint64_t value) {
+        if (pwrite(fd, &value, sizeof value, 0) != static_cast<ssize_t>(sizeof value))
+            throw runtime_error("Unable to update " + string(LOCK_FILE));
+    }
+
+private:
+    // This process's holders of one byte
+    struct Holders {
+        condition_variable ready;
+        int readers = 0;
+        bool writer = false;
+        bool acquiring = false; // The record lock is being waited for
+        int waiting = 0, writersWaiting = 0;
+    };
+
+    int fd;
+    mutex holdersLock;
+    unordered_map<off_t, Holders> holders; // Only bytes that are held or waited for
+
+    // Wakes the byte's waiters, or forgets the byte if there are none
+    void release(off_t byte, Holders& h) {
+        if (h.waiting > 0) h.ready.notify_all();
+        else if (!h.writer && h.readers == 0 && !h.acquiring) holders.erase(byte);
+    }
+
+    void set(off_t byte, short type) {
+        struct flock region{};
+        region.l_type = type;
+        region.l_whence = SEEK_SET;
+        region.l_start = byte;
+        region.l_len = 1;
+        while (fcntl(fd, F_SETLKW, &region) != 0) {
+            // The kernel tracks record locks per process, so a background
+            // compaction holding one byte while the main thread waits on
+            // another can look like a deadlock that is not real: back off
+            if (errno == EDEADLK) this_thread::sleep_for(chrono::milliseconds(1));
+            else if (errno != EINTR) throw runtime_error("Unable to lock " + string(LOCK_FILE) + ": " + strerror(errno));
+        }
+    }
+};
+
+// Holds one byte of a LockFile for the lifetime of the object
+class RangeLock {
+public:
+    RangeLock(LockFile& file, off_t lockByte, bool exclusive) : locks(file), byte(lockByte) {
+        locks.lock(byte, exclusive);
+    }
+    ~RangeLock() { locks.unlock(byte); }
+
+    RangeLock(const RangeLock&) = delete;
+    RangeLock& operator=(const RangeLock&) = delete;
+
+private:
+    LockFile& locks;
+    off_t byte;
+};
+
+// ----------------- Journal -----------------
+
+const char* const JOURNAL_FILE = "hotel.journal";                  // Live append-only log
+const char* const JOURNAL_COMPACTING_FILE = "hotel.journal.compacting"; // Log being folded into the data files
+
+// Append-only log of store mutations, one record per line.
+// Every record sets the final state of a single room or booking, or of
+// all the bookings of one group, so
+// replaying a record that is already reflected in the data files is a
+// no-op. That is what lets compaction rewrite the data files first and
+// drop the log afterwards without a crash in between losing anything.
+//
+// The log is also how processes sharing the directory see each other's
+// changes: catchUp() applies whatever other processes appended since the
+// last call. Each record goes out in a single O_APPEND write under the
+// append lock, and the position of our own records is remembered so they
+// are not applied twice. Rotations bump the generation kept in hotel.lock,
+// which tells a reader whether a log it never got to see was folded away.
+// The threads of one process share a Journal; its methods are safe to call
+// concurrently.
+//
+// With a durability other than None, a writer calls waitDurable() with the
+// ticket append() gave it before acknowledging the change. Waiting writers
+// take turns leading: the leader syncs everything appended so far, and the
+// others are released by that sync if it covers their records. In group
+// mode the leader first waits up to the group window for the writers still
+// on their way (see PendingWrite), or until groupSize writers are waiting,
+// so that one sync covers a whole burst of appends.
+class Journal {
+public:
+    ~Journal() { close(); }
+
+    // Counts a writer from before it takes its locks until it has waited
+    // for its sync, so that a group leader knows whom to wait for
+    class PendingWrite {
+    public:
+        explicit PendingWrite(Journal& log) : journal(log) { journal.startWrite(); }
+        ~PendingWrite() { journal.finishWrite(); }
+
+        PendingWrite(const PendingWrite&) = delete;
+        PendingWrite& operator=(const PendingWrite&) = delete;
+
+    private:
+        Journal& journal;
+    };
+
+    void setDurability(Durability level, chrono::microseconds window, size_t groupSize) {
+        durability = level;
+        groupWindow = window;
+        groupLimit = max<size_t>(1, groupSize);
+    }
+
+    // Opens the log at path (creating it if needed) and positions the
+    // reader at its start. The caller holds the rotation lock.
+    void open(const string& logPath, LockFile& lockFile) {
+        lock_guard<mutex> guard(filesLock);
+        closeFiles();
+        path = logPath;
+        locks = &lockFile;
+        openReader(locks->generation());
+        openWriter();
+    }
+
+    void close() {
+        lock_guard<mutex> guard(filesLock);
+        closeFiles();
+    }
+
+    // Appends records in one write, so they reach the log together.
+    // Returns the ticket to pass to waitDurable().
+    uint64_t append(const vector<string>& records) {
+        if (records.empty()) return 0;
+        RangeLock appending(*locks, LOCK_JOURNAL_APPEND, true);
+        lock_guard<mutex> guard(filesLock); // Keeps a concurrent catchUp() from reading a record not yet marked ours
+
+        // Another process may have rotated the log since the last write
+        if (locks->generation() != writeGeneration) openWriter();
+
+        // Terminate a record torn by a crash so ours starts on a fresh line
+        struct stat st;
+        string lines;
+        off_t sizeBefore = fstat(writeFd, &st) == 0 ? st.st_size : -1;
+        if (sizeBefore > 0) {
+            char last = '\n';
+            if (pread(writeFd, &last, 1, st.st_size - 1) == 1 && last != '\n') lines += '\n';
+        }
+        vector<size_t> starts;
+        for (const auto& record : records) {
+            starts.push_back(lines.size());
+            lines += record;
+            lines += '\n';
+        }
+
+        STATS_TIME("journal.write");
+        ssize_t written = ::write(writeFd, lines.data(), lines.size());
+        if (written != static_cast<ssize_t>(lines.size())) {
+            // Take back a partial write, so that terminating it later cannot
+            // turn its fragment into a record
+            bool undone = written <= 0 || (sizeBefore >= 0 && ftruncate(writeFd, sizeBefore) == 0);
+            throw runtime_error(undone ? "Failed writing journal record" : "Failed writing journal record; a torn record remains");
+        }
+        STATS_COUNT("journal.bytesWritten", lines.size());
+
+        off_t begin = lseek(writeFd, 0, SEEK_CUR) - static_cast<off_t>(lines.size());
+        for (size_t start : starts) ownRecords.insert({writeGeneration, begin + static_cast<off_t>(start)});
+        return ++appended;
+    }
+
+    // Returns once the append that gave ticket is on disk (at once with
+    // durability None). Call it without holding locks other writers need,
+    // or they cannot join the sync.
+    void waitDurable(uint64_t ticket) {
+        if (durability == Durability::None || ticket == 0) return;
+        unique_lock<mutex> guard(syncLock);
+        ++waiting;
+        syncDone.notify_all(); // A leader gathering a group may have everyone now
+        while (durable < ticket) {
+            if (syncing) {
+                syncDone.wait(guard);
+                continue;
+            }
+            syncing = true;
+            if (durability == Durability::Group)
+                syncDone.wait_for(guard, groupWindow, [&] { return waiting >= groupLimit || waiting >= writers; });
+
+            uint64_t target;
+            int fd;
+            {
+                lock_guard<mutex> files(filesLock);
+                target = appended;
+                fd = ::dup(writeFd); // The writer may move to a new log while we sync
+            }
+            guard.unlock();
+            bool ok;
+            {
+                STATS_TIME("journal.sync");
+                ok = fd >= 0 && ::fdatasync(fd) == 0;
+            }
+            if (fd >= 0) ::close(fd);
+            guard.lock();
+            syncing = false;
+            if (ok) {
+                durable = max<uint64_t>(durable, target);
+                ++syncs;
+            }
+            syncDone.notify_all();
+            if (!ok) {
+                --waiting;
+                throw runtime_error("Failed syncing " + path);
+            }
+        }
+        --waiting;
+    }
+
+    // Number of syncs made for waitDurable()
+    uint64_t syncCount() const { return syncs; }
+
+    // Applies records appended by other processes since the last call.
+    // If the log was rotated meanwhile, the old file is read to its end
+    // before moving on to the new one. Returns false if it was rotated more
+    // than once: the logs in between are gone, and the caller has to reload
+    // the data files and reopen the journal. The caller holds the rotation lock.
+    template <typename Apply>
+    bool catchUp(Apply apply) {
+        lock_guard<mutex> guard(filesLock);
+        drain(apply);
+        uint64_t current = locks->generation();
+        if (current == readGeneration) return true;
+        if (current != readGeneration + 1) return false;
+        drain(apply); // Nothing is appended to a rotated log, so this reaches its true end
+        openReader(current);
+        drain(apply);
+        return true;
+    }
+
+    // Feeds every complete record of a log to apply; returns false if the file does not exist
+    template <typename Apply>
+    static bool replay(const string& path, Apply apply) {
+        ifstream in(path, ios::binary);
+        if (!in) return false;
+
+        string line;
+        size_t lineNo = 0;
+        while (getline(in, line)) {
+            ++lineNo;
+            if (in.eof()) break; // No trailing newline: the write was torn by a crash
+            if (line.empty()) continue;
+            try {
+                apply(line);
+            } catch (const exception& e) {
+                cerr << "Error replaying " << path << ": " << e.what() << " (line " << lineNo << ": " << line << ")\n";
+            }
+        }
+        return true;
+    }
+
+private:
+    string path;
+    LockFile* locks = nullptr;
+    int readFd = -1, writeFd = -1;
+    uint64_t readGeneration = 0, writeGeneration = 0;
+    off_t readOffset = 0;                  // Start of the first record not yet seen by the reader
+    string pending;                        // Bytes read past the last complete record
+    set<pair<uint64_t, off_t>> ownRecords; // Where this process's records start
+    uint64_t appended = 0;                 // Tickets handed out by append()
+    mutex filesLock;                       // Guards everything above between threads
+
+    Durability durability = Durability::None;
+    chrono::microseconds groupWindow{2000};
+    size_t groupLimit = 64;
+    atomic<uint64_t> durable{0}; // Every ticket up to this one is on disk
+    atomic<uint64_t> syncs{0};
+    size_t waiting = 0;          // Writers inside waitDurable()
+    size_t writers = 0;          // Writers inside a PendingWrite
+    bool syncing = false;        // A leader is gathering or syncing
+    mutex syncLock;              // Guards waiting and syncing; taken before filesLock
+    condition_variable syncDone;
+
+    void startWrite() {
+        if (durability != Durability::Group) return;
+        lock_guard<mutex> guard(syncLock);
+        ++writers;
+    }
+
+    void finishWrite() {
+        if (durability != Durability::Group) return;
+        lock_guard<mutex> guard(syncLock);
+        --writers;
+        syncDone.notify_all(); // One fewer to wait for
+    }
+
+    void closeFiles() {
+        if (readFd >= 0) ::close(readFd);
+        retireWriter();
+        readFd = -1;
+        pending.clear();
+        ownRecords.clear();
+    }
+
+    void openReader(uint64_t generation) {
+        if (readFd >= 0) ::close(readFd);
+        readFd = ::open(path.c_str(), O_RDONLY | O_CREAT, 0644);
+        if (readFd < 0) throw runtime_error("Unable to open " + path);
+        // Own records in older logs have all been drained by now
+        ownRecords.erase(ownRecords.begin(), ownRecords.lower_bound({generation, 0}));
+        readGeneration = generation;
+        readOffset = 0;
+        pending.clear();
+    }
+
+    void openWriter() {
+        retireWriter();
+        writeFd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (writeFd < 0) throw runtime_error("Unable to open " + path + " for appending");
+        writeGeneration = locks->generation();
+        if (durability != Durability::None) syncDirectoryOf(path); // The log may have just been created
+    }
+
+    // Closes the writer, first syncing any records still waiting for it
+    void retireWriter() {
+        if (writeFd < 0) return;
+        if (durability != Durability::None && durable < appended && ::fdatasync(writeFd) == 0) durable = appended;
+        ::close(writeFd);
+        writeFd = -1;
+    }
+
+    // Reads the reader's file to its current end and applies complete records
+    template <typename Apply>
+    void drain(Apply apply) {
+        char buf[1 << 16];
+        ssize_t n;
+        while ((n = pread(readFd, buf, sizeof buf, readOffset + static_cast<off_t>(pending.size()))) > 0)
+            pending.append(buf, static_cast<size_t>(n));
+
+        size_t consumed = 0;
+        size_t nl;
+        while ((nl = pending.find('\n', consumed)) != string::npos) {
+            off_t at = readOffset + static_cast<off_t>(consumed);
+            string line = pending.substr(consumed, nl - consumed);
+            consumed = nl + 1;
+            if (line.empty()) continue;
+            if (ownRecords.erase({readGeneration, at})) continue;
+            try {
+                apply(line);
+            } catch (const exception& e) {
+                cerr << "Error replaying " << path << ": " << e.what() << " (" << line << ")\n";
+            }
+        }
+        readOffset += static_cast<off_t>(consumed);
+        pending.erase(0, consumed);
+    }
+};
+
+// ----------------- Pricing -----------------
+
+const char* const RATES_FILE = "rates.txt";
+
+// One stay to be priced by PricingEngine::quoteAll
+struct QuoteRequest {
+    double nightly; // The room's nightly price (Room::price)
+    int checkIn;    // Day number of the first night, or NO_DATE for an undated stay
+    int nights;
+};
+
+// Prices stays from a single rate table keyed by room type, which also
+// supplies the nightly price stored on rooms when they are added or
+// retyped. A night in a room costs the room's nightly price (its type's
+// base rate unless an import set another) times the seasonal multiplier
+// for its date and the multiplier for its day of the week; the stay then
+// gets the largest length-of-stay discount it qualifies for and is rounded
+// to cents. Undated stays are charged the nightly price. The built-in
+// table has no seasons, weekday plans or discounts; rates.txt, if present,
+// replaces it:
+//   base,<type>,<nightly rate>
+//   season,<MM-DD>,<MM-DD>,<multiplier>   inclusive, may wrap past New Year
+//   weekday,<Mon..Sun>,<multiplier>
+//   stay,<min nights>,<discount percent>
+class PricingEngine {
+public:
+    PricingEngine() {
+        seasonFactor.fill(1.0);
+        weekdayFactor.fill(1.0);
+    }
+
+    // The built-in Single/Double/Suite table
+    static PricingEngine defaults() {
+        PricingEngine engine;
+        engine.rates = {{"Single", 100.0}, {"Double", 180.0}, {"Suite", 300.0}};
+        return engine;
+    }
+
+    // Reads a rate table in the format above; throws on a malformed line
+    static PricingEngine fromFile(const string& path) {
+        PricingEngine engine;
+        MappedFile file(path);
+        forEachLine(file.view(), [&](string_view line, size_t lineNo) {
+            if (line.front() == '#') return;
+            if (!engine.parseLine(line))
+                throw runtime_error("Invalid rate in " + path + " (line " + to_string(lineNo) + "): " + string(line));
+        });
+        if (engine.rates.empty()) throw runtime_error(path + " defines no base rates");
+        sort(engine.stayDiscounts.begin(), engine.stayDiscounts.end());
+        return engine;
+    }
+
+    // Index of a room type for QuoteRequest. Unknown types are priced as
+    // Single, or as the first type in the table if there is no Single.
+    int typeIndex(const string& type) const {
+        int fallback = 0;
+        for (size_t i = 0; i < rates.size(); ++i) {
+            if (rates[i].first == type) return static_cast<int>(i);
+            if (rates[i].first == "Single") fallback = static_cast<int>(i);
+        }
+        return fallback;
+    }
+
+    // Nightly base rate of a room type
+    double baseRate(const string& type) const { return rates[typeIndex(type)].second; }
+
+    // Total for one stay in room, at the room's own nightly price; what
+    // every booking is charged
+    double quote(const Room& room, int checkIn, int nights) const { return quoteAt(room.price, checkIn, nights); }
+
+    // Total for one stay at a room type's base rate
+    double quote(int type, int checkIn, int nights) const { return quoteAt(rates[type].second, checkIn, nights); }
+
+    double quote(const string& type, int checkIn, int nights) const { return quote(typeIndex(type), checkIn, nights); }
+
+    // Total for one stay at a nightly price
+    double quoteAt(double nightly, int checkIn, int nights) const {
+        return round(stayTotal(nightly, checkIn, nights) * 100.0) / 100.0;
+    }
+
+    // What one unit of nightly price comes to over a stay, before rounding:
+    // every room's quote for the stay is its nightly price times this
+    double stayFactor(int checkIn, int nights) const { return stayTotal(1.0, checkIn, nights); }
+
+    // Quotes every request into totals, which is resized once; nothing is
+    // allocated per quote, so thousands of results can be priced per call
+    void quoteAll(const vector<QuoteRequest>& requests, vector<double>& totals) const {
+        totals.resize(requests.size());
+        for (size_t i = 0; i < requests.size(); ++i)
+            totals[i] = quoteAt(requests[i].nightly, requests[i].checkIn, requests[i].nights);
+    }
+
+private:
+    vector<pair<string, double>> rates;       // Room type -> nightly base rate
+    array<double, 12 * 31> seasonFactor;      // Indexed by (month - 1) * 31 + (day - 1)
+    array<double, 7> weekdayFactor;           // Monday first
+    vector<pair<int, double>> stayDiscounts;  // Minimum nights -> percent off, ascending
+    bool flat = true;                         // No seasonal or weekday plans: skip the per-night walk
+
+    bool parseLine(string_view line) {
+        FieldCursor fields{line};
+        string_view kind, f;
+        if (!fields.next(kind)) return false;
+
+        if (kind == "base") {
+            double rate;
+            string_view type;
+            if (!fields.next(type) || type.empty() || !fields.next(f) || !parseNumber(f, rate) || rate < 0) return false;
+            rates.emplace_back(string(type), rate);
+        } else if (kind == "season") {
+            string_view from, to;
+            int fromIndex, toIndex;
+            double factor;
+            if (!fields.next(from) || !fields.next(to) || !fields.next(f)) return false;
+            if (!parseMonthDay(from, fromIndex) || !parseMonthDay(to, toIndex) || !parseNumber(f, factor)) return false;
+            for (int i = fromIndex;; i = (i + 1) % static_cast<int>(seasonFactor.size())) {
+                seasonFactor[i] = factor;
+                if (i == toIndex) break;
+            }
+            flat = false;
+        } else if (kind == "weekday") {
+            static const char* const names[] = {"Mon", "Tue", "Wed", "Thu", "Fri", "Sat", "Sun"};
+            string_view name;
+            double factor;
+            if (!fields.next(name) || !fields.next(f) || !parseNumber(f, factor)) return false;
+            auto it = find(begin(names), end(names), name);
+            if (it == end(names)) return false;
+            weekdayFactor[it - begin(names)] = factor;
+            flat = false;
+        } else if (kind == "stay") {
+            int minNights;
+            double percent;
+            if (!fields.next(f) || !parseNumber(f, minNights) || minNights < 1) return false;
+            if (!fields.next(f) || !parseNumber(f, percent) || percent < 0 || percent > 100) return false;
+            stayDiscounts.emplace_back(minNights, percent);
+        } else {
+            return false;
+        }
+        return !fields.next(f); // No trailing fields
+    }
+
+    // A stay's total at a nightly price, unrounded
+    double stayTotal(double nightly, int checkIn, int nights) const {
+        double total = 0;
+        if (checkIn == NO_DATE || flat) {
+            total = nightly * nights;
+        } else {
+            for (int day = checkIn; day < checkIn + nights; ++day) {
+                int y; unsigned m, d;
+                civilFromDays(day, y, m, d);
+                int weekday = ((day % 7) + 10) % 7; // Day 0 (1970-01-01) was a Thursday; Monday is 0
+                total += nightly * seasonFactor[(m - 1) * 31 + (d - 1)] * weekdayFactor[weekday];
+            }
+        }
+        for (auto it = stayDiscounts.rbegin(); it != stayDiscounts.rend(); ++it) {
+            if (nights >= it->first) {
+                total *= 1.0 - it->second / 100.0;
+                break;
+            }
+        }
+        return total;
+    }
+
+    // Parses MM-DD into a seasonFactor index
+    static bool parseMonthDay(string_view text, int& index) {
+        int month, day;
+        if (text.size() != 5 || text[2] != '-' || !parseNumber(text.substr(0, 2), month) || !parseNumber(text.substr(3, 2), day))
+            return false;
+        if (month < 1 || month > 12 || day < 1 || day > 31) return false;
+        index = (month - 1) * 31 + (day - 1);
+        return true;
+    }
+};
+
+// The rate table in use: rates.txt if it exists, the built-in one otherwise
+const PricingEngine& pricing() {
+    static const PricingEngine engine =
+        fileStamp(RATES_FILE).exists() ? PricingEngine::fromFile(RATES_FILE) : PricingEngine::defaults();
+    return engine;
+}
+
+// Cost of an undated stay of the given number of nights
+double calculatePrice(const string& type, int nights) {
+    return pricing().quote(type, NO_DATE, nights);
+}
+
+// Nightly price stored on a room of the given type when it is added or retyped
+double roomListPrice(const string& type) {
+    return pricing().baseRate(type);
+}
+
+// Capitalizes a room type as typed ("suite" -> "Suite");
+// returns false if it is not Single, Double or Suite
+bool normalizeRoomType(string& type) {
+    transform(type.begin(), type.end(), type.begin(), ::tolower);
+    if (!type.empty()) type[0] = toupper(type[0]);
+    return type == "Single" || type == "Double" || type == "Suite";
+}
+
+// ----------------- Hotel Store -----------------
+
+// Packed set of room positions (indexes into HotelStore's room vector).
+// Bits past the end of the words are clear, so sets of different lengths
+// combine as if padded with zeros.
+class RoomBitset {
+public:
+    void set(size_t bit) {
+        if (bit / 64 >= words.size()) words.resize(bit / 64 + 1);
+        words[bit / 64] |= uint64_t(1) << (bit % 64);
+    }
+
+    void reset(size_t bit) {
+        if (bit / 64 < words.size()) words[bit / 64] &= ~(uint64_t(1) << (bit % 64));
+    }
+
+    bool test(size_t bit) const { return bit / 64 < words.size() && (words[bit / 64] >> (bit % 64) & 1); }
+
+    bool none() const {
+        for (uint64_t w : words)
+            if (w) return false;
+        return true;
+    }
+
+    size_t count() const {
+        size_t total = 0;
+        for (uint64_t w : words) total += static_cast<size_t>(__builtin_popcountll(w));
+        return total;
+    }
+
+    // Size of the intersection with other, without building it
+    size_t countAnd(const RoomBitset& other) const {
+        size_t total = 0, n = min(words.size(), other.words.size());
+        for (size_t i = 0; i < n; ++i) total += static_cast<size_t>(__builtin_popcountll(words[i] & other.words[i]));
+        return total;
+    }
+
+    void andWith(const RoomBitset& other) {
+        if (words.size() > other.words.size()) words.resize(other.words.size());
+        for (size_t i = 0; i < words.size(); ++i) words[i] &= other.words[i];
+    }
+
+    void andNot(const RoomBitset& other) {
+        size_t n = min(words.size(), other.words.size());
+        for (size_t i = 0; i < n; ++i) words[i] &= ~other.words[i];
+    }
+
+    // Calls fn with each set bit in ascending order, skipping clear words
+    template <typename Fn>
+    void forEach(Fn fn) const {
+        for (size_t i = 0; i < words.size(); ++i) {
+            for (uint64_t w = words[i]; w; w &= w - 1)
+                fn(i * 64 + static_cast<size_t>(__builtin_ctzll(w)));
+        }
+    }
+
+private:
+    vector<uint64_t> words;
+};
+
+// A vector stored as chunks of CHUNK elements shared between copies.
+// Copying one copies just the chunk pointers; writing to a chunk that a
+// copy still shares clones that chunk first, so copies never see later
+// writes. Copies and writes must not race on the same CowVector object,
+// but a copy may be read and dropped on any thread.
+template <typename T>
+class CowVector {
+public:
+    static constexpr size_t CHUNK = 1024;
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    const T& operator[](size_t i) const { return (*chunks[i / CHUNK])[i % CHUNK]; }
+
+    // The element at i, for writing
+    T& mutate(size_t i) { return own(i / CHUNK)[i % CHUNK]; }
+    void set(size_t i, const T& value) { mutate(i) = value; }
+
+    void push_back(const T& value) {
+        if (count % CHUNK == 0) {
+            chunks.push_back(make_shared<vector<T>>());
+            chunks.back()->reserve(CHUNK);
+        }
+        own(chunks.size() - 1).push_back(value);
+        ++count;
+    }
+
+    void clear() {
+        chunks.clear();
+        count = 0;
+    }
+
+    void assign(const vector<T>& values) {
+        clear();
+        for (const auto& value : values) push_back(value);
+    }
+
+    void assign(size_t n, const T& value) {
+        clear();
+        for (size_t i = 0; i < n; ++i) push_back(value);
+    }
+
+    // Removes the element at i by rebuilding the vector, which is O(size)
+    void erase(size_t i) {
+        vector<T> values = toVector();
+        values.erase(values.begin() + static_cast<ptrdiff_t>(i));
+        assign(values);
+    }
+
+    vector<T> toVector() const {
+        vector<T> values;
+        values.reserve(count);
+        for (const auto& chunk : chunks) values.insert(values.end(), chunk->begin(), chunk->end());
+        return values;
+    }
+
+    class const_iterator {
+    public:
+        const_iterator(const CowVector* owner, size_t i) : owner(owner), i(i) {}
+        const T& operator*() const { return (*owner)[i]; }
+        const T* operator->() const { return &(*owner)[i]; }
+        const_iterator& operator++() {
+            ++i;
+            return *this;
+        }
+        bool operator!=(const const_iterator& other) const { return i != other.i; }
+        bool operator==(const const_iterator& other) const { return i == other.i; }
+
+    private:
+        const CowVector* owner;
+        size_t i;
+    };
+
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, count); }
+
+private:
+    vector<shared_ptr<vector<T>>> chunks;
+    size_t count = 0;
+
+    vector<T>& own(size_t chunk) {
+        auto& shared = chunks[chunk];
+        if (shared.use_count() > 1) {
+            shared = make_shared<vector<T>>(*shared);
+            shared->reserve(CHUNK);
+        } else {
+            atomic_thread_fence(memory_order_acquire); // A copy dropped on another thread is done reading
+        }
+        return *shared;
+    }
+};
+
+// How HotelStore persists mutations
+enum class StorageMode {
+    Rewrite, // Rewrite rooms.txt/bookings.txt after every change
+    Journal  // Append to hotel.journal and fold it into the data files on compaction
+};
+
+// A room search for HotelStore::searchRooms: rooms of roomType (any type
+// if empty) that are charged within [minCents, maxCents] a night on
+// average for the stay (for one night if checkIn is NO_DATE) and, unless
+// checkIn is NO_DATE, that are free for [checkIn, checkOut). Results come
+// cheapest first (dearest first if descending), at most limit of them.
+struct RoomQuery {
+    string roomType;
+    int64_t minCents = 0;
+    int64_t maxCents = numeric_limits<int64_t>::max();
+    int checkIn = NO_DATE, checkOut = NO_DATE;
+    bool descending = false;
+    size_t limit = numeric_limits<size_t>::max();
+};
+
+// Keeps all rooms and bookings in memory for the lifetime of the process.
+// The data files are parsed once by load(); every lookup afterwards goes
+// through hash indexes keyed by room number instead of re-reading the files.
+//
+// Several threads may share one store: updates go through withRoom() or
+// withBatch(), and the lookups below are made inside read(). Long reads
+// (listings, reports) take a view() instead, which does not hold up
+// updates. Everything else assumes a single thread.
+class HotelStore {
+public:
+    // A consistent, read-only picture of the rooms and bookings as they
+    // were when it was taken. Taking one copies a pointer per 1024 records;
+    // updates carry on meanwhile, cloning a chunk of records the first time
+    // they change it while a view still shares it. The chunks of an old
+    // version are freed when the last view holding them is dropped.
+    class View {
+    public:
+        // All rooms in file order
+        const CowVector<Room>& allRooms() const { return rooms; }
+
+        size_t bookingCount() const { return liveCount; }
+
+        // As HotelStore::forEachBooking()
+        template <typename Fn>
+        void forEachBooking(Fn fn) const { forEachLiveBooking(bookings, bookingLive, 0, 1, fn); }
+
+        // As HotelStore::forEachBookingInSlice()
+        template <typename Fn>
+        void forEachBookingInSlice(size_t slice, size_t slices, Fn fn) const {
+            forEachLiveBooking(bookings, bookingLive, slice, slices, fn);
+        }
+
+        // Where the last bookingAt() call found its booking
+        struct BookingCursor {
+            size_t row = 0;
+            size_t slot = numeric_limits<size_t>::max();
+        };
+
+        // The row-th live booking in file order (row < bookingCount()).
+        // Without cancelled slots waiting for compaction the row is the
+        // slot; otherwise the search walks from whichever is nearest of the
+        // cursor, the first and the last booking, so paging through a
+        // listing costs about the rows it moves over rather than a pass over
+        // every booking. Dead slots never much outnumber the live ones (see
+        // reclaimBookingSlots()), which bounds the walk.
+        const Booking& bookingAt(size_t row, BookingCursor& at) const {
+            if (liveCount == bookings.size()) return bookings[row];
+            size_t fromCursor = at.slot == numeric_limits<size_t>::max() ? numeric_limits<size_t>::max()
+                                                                          : max(row, at.row) - min(row, at.row);
+            if (row < fromCursor && row <= liveCount - 1 - row) {
+                at = {0, 0};
+                while (!bookingLive[at.slot]) ++at.slot;
+            } else if (liveCount - 1 - row < fromCursor) {
+                at = {liveCount - 1, bookings.size() - 1};
+                while (!bookingLive[at.slot]) --at.slot;
+            }
+            for (; at.row < row; ++at.row)
+                while (!bookingLive[++at.slot]) {}
+            for (; at.row > row; --at.row)
+                while (!bookingLive[--at.slot]) {}
+            return bookings[at.slot];
+        }
+
+        vector<Booking> liveBookings() const {
+            vector<Booking> live;
+            live.reserve(liveCount);
+            forEachBooking([&](const Booking& b) { live.push_back(b); });
+            return live;
+        }
+
+        // Whether the room at position in allRooms() is held by a legacy
+        // booking or has a stay on the night the view was taken for (see
+        // HotelStore::view(int))
+        bool isOccupied(size_t position) const { return !available.test(position) || stayingOn.test(position); }
+
+    private:
+        friend class HotelStore;
+        CowVector<Room> rooms;
+        CowVector<Booking> bookings;
+        CowVector<char> bookingLive;
+        size_t liveCount = 0;
+        RoomBitset available, stayingOn; // Copies of the store's bitsets, for view(int) only
+    };
+
+    // A store for the data files in directory, or in the working directory if it is empty
+    explicit HotelStore(const string& directory = "") : dataDir(directory) { layout.base = directory; }
+
+    ~HotelStore() { waitForCompaction(); }
+
+    // Selects how changes are written; compactEvery is the journal length
+    // that triggers a background compaction (0 disables the trigger)
+    void setStorageMode(StorageMode storageMode, size_t compactEvery = 1000) {
+        mode = storageMode;
+        compactThreshold = compactEvery;
+    }
+
+    // Tags the rooms and bookings kept here as those of property (see
+    // PropertySet); call before load()
+    void setProperty(uint16_t id) { property = id; }
+
+    // Keeps hotel.snap alongside the text files and starts from it when it is current
+    void setSnapshotsEnabled(bool enabled) { snapshots = enabled; }
+
+    // Selects whether withRoom() and withBatch() return only once their
+    // changes are on disk. In journal mode, Group lets changes from a
+    // window of groupWindow or up to groupSize writers share one sync;
+    // rewrite mode syncs every file it rewrites, so there Group is Strict.
+    void setDurability(Durability level, chrono::microseconds groupWindow = chrono::microseconds(2000), size_t groupSize = 64) {
+        durability = level;
+        journal.setDurability(level, groupWindow, groupSize);
+    }
+
+    // Syncs made for the journal so far, for measuring how well they group
+    uint64_t journalSyncs() const { return journal.syncCount(); }
+
+    // Reads rooms.txt and bookings.txt (or a current snapshot of them, or
+    // the shard files in the sharded layout), replays the journal, and
+    // builds the indexes.
+    // In rewrite mode leftover journals are folded into the data files
+    // straight away; in journal mode the log is shared with any other
+    // process using the directory and is left for compaction.
+    void load() {
+        if (!locks) locks = make_unique<LockFile>(file(LOCK_FILE));
+        bool journaled = mode == StorageMode::Journal;
+        bool leftover = false;
+        {
+            RangeLock rotation(*locks, LOCK_JOURNAL_ROTATION, !journaled);
+            unique_lock<shared_mutex> state(stateLock);
+            if (journaled) {
+                leftover = readJournaledState();
+            } else {
+                RangeLock data(*locks, LOCK_DATA_FILES, true);
+                readDataFiles();
+                auto apply = [this](const string& record) { applyRecord(record); };
+                bool compacting = Journal::replay(file(JOURNAL_COMPACTING_FILE), apply);
+                if (Journal::replay(file(JOURNAL_FILE), apply) || compacting) {
+                    writeDataFiles(layout, rooms.toVector(), liveBookings(), nullptr, snapshots, syncWrites());
+                    noteDataFiles();
+                    dropJournals();
+                }
+            }
+        }
+        if (journaled && leftover) compact(); // A compaction was interrupted by a crash
+    }
+
+    // Brings the in-memory state up to date with changes other processes
+    // have made to the shared data directory
+    void refresh() {
+        if (mode == StorageMode::Journal) {
+            RangeLock rotation(*locks, LOCK_JOURNAL_ROTATION, false); // Never read across two rotations
+            unique_lock<shared_mutex> state(stateLock);
+            catchUp();
+        } else {
+            RangeLock data(*locks, LOCK_DATA_FILES, false);
+            unique_lock<shared_mutex> state(stateLock);
+            reloadIfChanged();
+        }
+    }
+
+    // Runs fn, which only looks rooms and bookings up, alongside other
+    // readers; updates made by other threads wait until it returns
+    template <typename Fn>
+    auto read(Fn fn) const {
+        shared_lock<shared_mutex> state(stateLock);
+        return fn();
+    }
+
+    // The rooms and bookings as they are now, to read at leisure
+    View view() const {
+        STATS_TIME("store.view");
+        shared_lock<shared_mutex> state(stateLock);
+        return viewLocked();
+    }
+
+    // Like view(), and also answers View::isOccupied() for night from
+    // copies of the availability and night bitsets, a word per 64 rooms
+    View view(int night) const {
+        STATS_TIME("store.view");
+        shared_lock<shared_mutex> state(stateLock);
+        View v = viewLocked();
+        v.available = availableRooms;
+        auto occupied = occupiedOn.find(night);
+        if (occupied != occupiedOn.end()) v.stayingOn = occupied->second;
+        return v;
+    }
+
+    // Runs fn as one update of a room that is safe against other processes.
+    // The room's lock is held throughout and the state is refreshed first,
+    // so checks made inside fn (is the room free, does the booking exist)
+    // still hold when fn writes; a conflicting update from another process
+    // is seen by those checks instead of being overwritten. Look rooms and
+    // bookings up inside fn: refreshing may move them in memory.
+    // In journal mode only updates of the same room wait for each other:
+    // the in-memory change is made under the store's lock, but the journal
+    // write happens after it is released, with just the room still locked,
+    // and waiting for the sync after that. If fn throws, nothing it changed
+    // is written; if the write fails, likewise. Either way the state is
+    // rebuilt from the disk (see discardUnwritten()) before the error
+    // reaches the caller.
+    // Rewrite mode serializes every update of the directory, whatever the
+    // room: each save rewrites whole data files (a whole shard's in the
+    // sharded layout) from the complete in-memory state, so it takes the
+    // data files' lock exclusively and the store's lock for the duration.
+    // The save waits until fn returns, so if fn throws the files are left
+    // as they were and read back in; a failed save reloads them too (see
+    // saveDirty()). Use journal mode where concurrent updates matter.
+    template <typename Fn>
+    void withRoom(int roomNumber, Fn fn) {
+        if (mode == StorageMode::Journal) {
+            Journal::PendingWrite pending(journal);
+            uint64_t ticket = 0;
+            exception_ptr failure;
+            bool unwritten = false;
+            {
+                RangeLock rotation(*locks, LOCK_JOURNAL_ROTATION, false);
+                RangeLock room(*locks, LOCK_FIRST_ROOM + static_cast<unsigned>(roomNumber), true);
+                vector<string> records;
+                try {
+                    unique_lock<shared_mutex> state(stateLock);
+                    catchUp(); // Not refresh(): that would take the rotation lock a second time
+                    collectRecords(records, fn);
+                } catch (...) {
+                    failure = current_exception();
+                    unwritten = !records.empty(); // Changed before it threw; most checks throw before any change
+                }
+                if (!failure) {
+                    try {
+                        ticket = appendRecords(records);
+                    } catch (...) {
+                        failure = current_exception();
+                        unwritten = true;
+                    }
+                }
+            }
+            if (unwritten) discardUnwritten();
+            if (failure) rethrow_exception(failure);
+            journal.waitDurable(ticket);
+            compactIfDue();
+        } else {
+            RangeLock data(*locks, LOCK_DATA_FILES, true);
+            unique_lock<shared_mutex> state(stateLock);
+            reloadIfChanged();
+            deferring = true;
+            try {
+                fn();
+            } catch (...) {
+                deferring = false;
+                bool changed = !dirtyRoomShards.empty() || !dirtyBookingShards.empty() || !roomsToAppend.empty();
+                dirtyRoomShards.clear();
+                dirtyBookingShards.clear();
+                roomsToAppend.clear();
+                if (changed) readDataFiles();
+                throw;
+            }
+            deferring = false;
+            saveDeferred();
+        }
+    }
+
+    // Runs fn as one batch of updates that is safe against other processes.
+    // Every room is locked throughout, and the changes fn makes are
+    // persisted together once it returns (or throws): one journal write,
+    // or one rewrite of each data file that changed, instead of one per
+    // change. Meant for bulk work, where the per-change cost dominates.
+    template <typename Fn>
+    void withBatch(Fn fn) {
+        if (mode == StorageMode::Journal) {
+            Journal::PendingWrite pending(journal);
+            uint64_t ticket;
+            {
+                RangeLock rotation(*locks, LOCK_JOURNAL_ROTATION, true); // Keeps every other writer out
+                unique_lock<shared_mutex> state(stateLock);
+                catchUp();
+                ticket = runBatched(fn);
+            }
+            journal.waitDurable(ticket);
+            compactIfDue();
+        } else {
+            RangeLock data(*locks, LOCK_DATA_FILES, true);
+            unique_lock<shared_mutex> state(stateLock);
+            reloadIfChanged();
+            runBatched(fn);
+        }
+    }
+
+    // Folds the journal back into rooms.txt/bookings.txt.
+    // The live log is rotated aside and the data files are rewritten from a
+    // copy of the current state on a background thread, so new changes can
+    // keep appending while the rewrite is in progress. Returns false when
+    // not in journal mode, where the data files are always up to date.
+    bool compact() {
+        if (mode != StorageMode::Journal) return false;
+        lock_guard<mutex> one(compactionLock);
+        return compactLocked();
+    }
+
+    // Rewrites the data in the target layout and switches the directory
+    // over to it, then removes the old files. The new files are complete
+    // and synced before shards/layout.txt changes, so a crash part-way
+    // leaves the old layout in use. Meant for a directory no other process
+    // is using, in rewrite mode, after load() has folded any journal in.
+    void migrateLayout(const ShardLayout& target) {
+        RangeLock rotation(*locks, LOCK_JOURNAL_ROTATION, true);
+        RangeLock data(*locks, LOCK_DATA_FILES, true);
+        unique_lock<shared_mutex> state(stateLock);
+        reloadIfChanged();
+        if (target == layout) return;
+
+        ShardLayout previous = layout, next = target;
+        next.base = dataDir;
+        string layoutFile = file(SHARD_LAYOUT_FILE);
+        if (next.sharded()) {
+            filesystem::remove_all(next.directory()); // Left by an interrupted migration
+            writeDataFiles(next, rooms.toVector(), liveBookings(), nullptr, false, true);
+            writeFileAtomically(layoutFile, [&](ostream& out) { out << "roomsPerShard," << next.roomsPerShard << "\n"; }, true);
+        } else {
+            writeDataFiles(next, rooms.toVector(), liveBookings(), nullptr, snapshots, true);
+            remove(layoutFile.c_str());
+            syncDirectoryOf(layoutFile);
+        }
+
+        error_code ec;
+        if (previous.sharded()) {
+            filesystem::remove_all(previous.directory(), ec);
+            if (!next.sharded()) filesystem::remove(file(SHARD_DIR), ec); // Only if nothing else is left in it
+        } else {
+            remove(file("rooms.txt").c_str());
+            remove(file("bookings.txt").c_str());
+            remove(file(SNAPSHOT_FILE).c_str());
+        }
+        layout = next;
+        noteDataFiles();
+    }
+
+    // The layout the data files are in
+    const ShardLayout& dataLayout() const { return layout; }
+
+    // Blocks until a background compaction, if any, has finished
+    void waitForCompaction() {
+        lock_guard<mutex> guard(compactorLock);
+        if (compactor.joinable()) compactor.join();
+    }
+
+
+    // ---- Rooms ----
+
+    // All rooms in file order
+    const CowVector<Room>& allRooms() const { return rooms; }
+
+    // Returns the room with the given number, or nullptr if it does not exist
+    const Room* findRoom(int roomNumber) const {
+        auto it = roomIndex.find(roomNumber);
+        return it == roomIndex.end() ? nullptr : &rooms[it->second];
+    }
+
+    // Returns true if the room exists, is not held by a legacy (undated)
+    // booking, and has no stay overlapping [checkIn, checkOut).
+    // Costs O(log n) in the number of stays booked for that room.
+    bool isRoomFree(int roomNumber, int checkIn, int checkOut) const {
+        const Room* r = findRoom(roomNumber);
+        if (!r || !r->isAvailable) return false;
+        auto it = stays.find(roomNumber);
+        return it == stays.end() || !overlaps(it->second, checkIn, checkOut);
+    }
+
+    // Number of rooms not held by a legacy booking, in O(1)
+    size_t availableRoomCount() const { return availableCount; }
+
+    // Rooms free for the whole of [checkIn, checkOut), in file order,
+    // optionally only those of one type. Built from the availability and
+    // nightly occupancy bitsets, so it costs one pass over a bitset per
+    // night and then only touches the rooms that are free.
+    vector<const Room*> freeRooms(int checkIn, int checkOut, const string& roomType = "") const {
+        RoomBitset free = freeMask(checkIn, checkOut, roomType);
+        vector<const Room*> result;
+        result.reserve(free.count());
+        free.forEach([&](size_t position) { result.push_back(&rooms[position]); });
+        return result;
+    }
+
+    // Number of rooms free for the whole of [checkIn, checkOut) per room type, by type name
+    vector<pair<string, size_t>> freeRoomCounts(int checkIn, int checkOut) const {
+        RoomBitset free = freeMask(checkIn, checkOut, "");
+        vector<pair<string, size_t>> counts;
+        for (const auto& [type, members] : roomsByType) counts.push_back({roomTypeNames().text(type), free.countAnd(members)});
+        sort(counts.begin(), counts.end());
+        return counts;
+    }
+
+    // Rooms matching query, in price order and by room number among equal
+    // prices. Walks the price index of the room type (or of all rooms) from
+    // the first price in range and stops at the limit, so it costs
+    // O(log n) plus one quote and one O(log stays) check per room it has to
+    // skip because it is taken; rooms outside the type or price range are
+    // never touched. Prices are compared as the stay is charged: every
+    // room's quote is its nightly price times the stay's factor (see
+    // PricingEngine::stayFactor()), so the index, ordered by nightly price,
+    // is in quote order too, and the rooms in range are one run of it whose
+    // ends the factor locates to within a cent.
+    vector<const Room*> searchRooms(const RoomQuery& query) const {
+        vector<const Room*> found;
+        if (query.limit == 0 || query.minCents > query.maxCents) return found;
+        const PriceIndex* index = &roomsByPrice;
+        if (!query.roomType.empty()) {
+            uint16_t typeIndex;
+            if (!RoomType::lookup(query.roomType, typeIndex)) return found;
+            auto type = roomsByTypeAndPrice.find(typeIndex);
+            if (type == roomsByTypeAndPrice.end()) return found;
+            index = &type->second;
+        }
+
+        int nights = query.checkIn == NO_DATE ? 1 : query.checkOut - query.checkIn;
+        double perNight = pricing().stayFactor(query.checkIn, nights) / nights; // Charged per cent of nightly price
+        auto priceFor = [&](int64_t cents) { // Nightly price charged cents a night, rounded down and clamped
+            double price = cents / perNight;
+            if (price <= -9e18) return -int64_t(9e18);
+            return price >= 9e18 ? int64_t(9e18) : static_cast<int64_t>(price);
+        };
+        // Prices in [lowest, highest] may be in range, those in [safeLow,
+        // safeHigh] surely are: a cent of leeway each side covers the
+        // rounding of the quotes, and only rooms in the leeway are quoted
+        int64_t lowest = numeric_limits<int64_t>::min(), highest = numeric_limits<int64_t>::max();
+        int64_t safeLow = lowest, safeHigh = highest;
+        if (perNight > 0) {
+            if (query.minCents > 0) {
+                lowest = priceFor(query.minCents - 1) - 1;
+                safeLow = priceFor(query.minCents + 1) + 1;
+            }
+            if (query.maxCents < highest) {
+                highest = priceFor(query.maxCents + 1);
+                safeHigh = priceFor(query.maxCents - 1) - 1;
+            }
+        } else {
+            safeLow = highest; // Every quote is 0; check them all
+            safeHigh = lowest;
+        }
+        auto first = index->lower_bound({lowest, numeric_limits<int>::min()});
+        auto last = index->upper_bound({highest, numeric_limits<int>::max()});
+
+        // Where a room's quote for the stay falls: below the range, in it or above it
+        auto compare = [&](const pair<int64_t, int>& entry) {
+            if (entry.first >= safeLow && entry.first <= safeHigh) return 0;
+            int64_t total = Money(pricing().quote(*findRoom(entry.second), query.checkIn, nights)).cents();
+            if (total / nights < query.minCents) return -1;
+            return (total + nights - 1) / nights > query.maxCents ? 1 : 0;
+        };
+        auto consider = [&](int roomNumber) {
+            if (query.checkIn == NO_DATE || isRoomFree(roomNumber, query.checkIn, query.checkOut))
+                found.push_back(findRoom(roomNumber));
+            return found.size() < query.limit;
+        };
+        if (query.descending) {
+            for (auto it = last; it != first;) {
+                int side = compare(*--it);
+                if (side < 0) break;
+                if (side == 0 && !consider(it->second)) break;
+            }
+        } else {
+            for (auto it = first; it != last; ++it) {
+                int side = compare(*it);
+                if (side > 0) break;
+                if (side == 0 && !consider(it->second)) break;
+            }
+        }
+        return found;
+    }
+
+    // Adds a room; returns false if the room number is already taken
+    bool addRoom(const Room& room) {
+        if (roomIndex.count(room.roomNumber)) return false;
+        putRoom(room);
+
+        if (mode == StorageMode::Rewrite && batching) {
+            dirtyRoomShards.insert(shardKey(room.roomNumber));
+        } else if (mode == StorageMode::Rewrite && deferring) {
+            roomsToAppend.push_back(room);
+        } else if (mode == StorageMode::Rewrite) {
+            appendRoom(room);
+        } else {
+            noteJournaled(room.roomNumber);
+            record("R," + room.serialize());
+        }
+        return true;
+    }
+
+    // Rewrite mode: a new room only adds a line, so it is appended
+    // instead of rewriting the file
+    void appendRoom(const Room& room) {
+        string path = layout.sharded() ? layout.roomsPath(layout.shardOf(room.roomNumber)) : file("rooms.txt");
+        if (layout.sharded()) filesystem::create_directories(layout.directory());
+        {
+            ofstream outFile(path, ios::app);
+            if (!outFile) throw runtime_error("Unable to open " + path + " for writing");
+            outFile << room.serialize() << "\n";
+        }
+        if (syncWrites()) {
+            syncFile(path);
+            syncDirectoryOf(path);
+        }
+        noteShardFiles({shardKey(room.roomNumber)}); // The other shards' stamps stay as last checked
+    }
+
+    // Removes a room; returns false if it does not exist
+    bool removeRoom(int roomNumber) {
+        if (!eraseRoom(roomNumber)) return false;
+        commit("D," + to_string(roomNumber), roomNumber, true, false);
+        return true;
+    }
+
+    // Changes the type and nightly price of an existing room
+    bool updateRoom(int roomNumber, const string& type, double price) {
+        const Room* r = roomAt(roomNumber);
+        if (!r) return false;
+        Room updated = *r;
+        updated.roomType = type;
+        updated.price = price;
+        replaceRoom(updated);
+        commit("R," + updated.serialize(), roomNumber, true, false);
+        return true;
+    }
+
+    // Marks a room as available or occupied
+    bool setRoomAvailable(int roomNumber, bool available) {
+        const Room* r = roomAt(roomNumber);
+        if (!r) return false;
+        if (r->isAvailable != available) {
+            Room updated = *r;
+            updated.isAvailable = available;
+            replaceRoom(updated);
+            commit("R," + updated.serialize(), roomNumber, true, false);
+        }
+        return true;
+    }
+
+    // ---- Bookings ----
+
+    // Calls fn for every booking in file order
+    template <typename Fn>
+    void forEachBooking(Fn fn) const { forEachLiveBooking(bookings, bookingLive, 0, 1, fn); }
+
+    // Calls fn for every booking in the slice-th of slices equal runs of
+    // booking slots, so that threads can each take a slice
+    template <typename Fn>
+    void forEachBookingInSlice(size_t slice, size_t slices, Fn fn) const {
+        forEachLiveBooking(bookings, bookingLive, slice, slices, fn);
+    }
+
+    // Calls fn for every booking held by one guest, in file order.
+    // Costs O(that guest's bookings), however many others there are.
+    template <typename Fn>
+    void forEachBookingOf(const string& guestName, Fn fn) const {
+        uint32_t guest;
+        if (!GuestName::lookup(guestName, guest)) return;
+        auto it = bookingsByGuest.find(guest);
+        if (it == bookingsByGuest.end()) return;
+        for (size_t slot : it->second) fn(bookings[slot]);
+    }
+
+    // Number of bookings currently in the system
+    size_t bookingCount() const { return bookings.size() - deadBookings; }
+
+    // Returns true if any booking exists for the room
+    bool hasBookingForRoom(int roomNumber) const {
+        auto it = bookingsByRoom.find(roomNumber);
+        return it != bookingsByRoom.end() && !it->second.empty();
+    }
+
+    // Returns the booking held by a guest for a room, or nullptr
+    const Booking* findBooking(const string& guestName, int roomNumber) const {
+        long slot = findBookingSlot(guestName, roomNumber);
+        return slot < 0 ? nullptr : &bookings[slot];
+    }
+
+    // Returns the booking confirmed under a reference ID, or nullptr, in O(1)
+    const Booking* findBookingByReference(const string& referenceID) const {
+        uint64_t key;
+        if (!ReferenceId::lookup(referenceID, key)) return nullptr;
+        auto it = bookingsByReference.find(key);
+        return it == bookingsByReference.end() ? nullptr : &bookings[it->second];
+    }
+
+    // Records a new booking
+    void addBooking(const Booking& booking) {
+        putBooking(booking);
+        commit("B," + booking.serialize(), booking.roomNumber, false, true);
+    }
+
+    // Removes a guest's booking for a room; returns false if none exists
+    bool cancelBooking(const string& guestName, int roomNumber) {
+        long slot = findBookingSlot(guestName, roomNumber);
+        if (slot < 0) return false;
+        dropBooking(slot);
+        reclaimBookingSlots();
+        commit("C," + to_string(roomNumber) + "," + guestName, roomNumber, false, true);
+        return true;
+    }
+
+    // Removes the booking confirmed under a reference ID; returns false if none exists.
+    // Journaled as a cancel by guest and room, so older logs stay readable.
+    bool cancelBookingByReference(const string& referenceID) {
+        uint64_t key;
+        if (!ReferenceId::lookup(referenceID, key)) return false;
+        auto it = bookingsByReference.find(key);
+        if (it == bookingsByReference.end()) return false;
+        Booking cancelled = bookings[it->second];
+        dropBooking(it->second);
+        reclaimBookingSlots();
+        commit("C," + to_string(cancelled.roomNumber) + "," + cancelled.guestName.str(), cancelled.roomNumber, false, true);
+        return true;
+    }
+
+    // Removes every booking for a room and returns how many were removed
+    size_t cancelRoomBookings(int roomNumber) {
+        size_t removed = dropRoomBookings(roomNumber);
+        if (removed > 0) commit("X," + to_string(roomNumber), roomNumber, false, true);
+        return removed;
+    }
+
+    // Calls fn for every booking of the group confirmed under groupReference, in booking order
+    template <typename Fn>
+    void forEachBookingOfGroup(const string& groupReference, Fn fn) const {
+        uint64_t key;
+        if (!ReferenceId::lookup(groupReference, key)) return;
+        auto it = bookingsByGroup.find(key);
+        if (it == bookingsByGroup.end()) return;
+        for (size_t slot : it->second) fn(bookings[slot]);
+    }
+
+    // Records the bookings of a group, which share their guest, stay and
+    // group reference ID and are for different rooms, as one change: a
+    // single journal record, or one rewrite of the bookings files. The
+    // caller has checked every room; nothing here can fail half-way.
+    // In the sharded layout a crash in the middle of the rewrite can leave
+    // some shards' files written and others not.
+    void addGroupBooking(const vector<Booking>& members) {
+        if (members.empty()) return;
+        for (const Booking& b : members) putBooking(b);
+        const Booking& first = members.front();
+        string groupRecord = "G," + first.guestName.str() + "," + to_string(first.nights) + "," +
+                             formatDate(first.checkIn) + "," + first.referenceID.str();
+        for (const Booking& b : members)
+            groupRecord += "," + to_string(b.roomNumber) + "," + formatCents(b.totalCost.cents());
+        commitGroup(groupRecord, members);
+    }
+
+    // Removes every booking of the group confirmed under groupReference as
+    // one change, and returns how many were removed
+    size_t cancelGroup(const string& groupReference) {
+        vector<Booking> removed;
+        forEachBookingOfGroup(groupReference, [&](const Booking& b) { removed.push_back(b); });
+        if (removed.empty()) return 0;
+        dropGroup(removed.front().referenceID.key());
+        commitGroup("K," + groupReference, removed);
+        return removed.size();
+    }
+
+    // Attaches a reference ID to a guest's booking; returns false if none exists
+    bool confirmBooking(const string& guestName, int roomNumber, const string& referenceID) {
+        long slot = findBookingSlot(guestName, roomNumber);
+        if (slot < 0) return false;
+        unindexReference(slot);
+        bookings.mutate(slot).referenceID = referenceID;
+        indexReference(slot);
+        commit("B," + bookings[slot].serialize(), roomNumber, false, true);
+        return true;
+    }
+
+private:
+    CowVector<Room> rooms;
+    unordered_map<int, size_t> roomIndex;              // roomNumber -> position in rooms
+
+    // Cancelled bookings are tombstoned rather than erased, so slot numbers
+    // held by the index stay valid; the vector is compacted once enough
+    // dead slots pile up.
+    CowVector<Booking> bookings;
+    CowVector<char> bookingLive;
+    size_t deadBookings = 0;
+
+    // The walk behind forEachBooking() and forEachBookingInSlice(), over
+    // the store's booking slots or a view's copy of them
+    template <typename Fn>
+    static void forEachLiveBooking(const CowVector<Booking>& bookings, const CowVector<char>& live, size_t slice, size_t slices, Fn fn) {
+        size_t begin = bookings.size() * slice / slices, end = bookings.size() * (slice + 1) / slices;
+        for (size_t i = begin; i < end; ++i)
+            if (live[i]) fn(bookings[i]);
+    }
+    unordered_map<int, vector<size_t>> bookingsByRoom; // roomNumber -> booking slots
+    unordered_map<uint32_t, vector<size_t>> bookingsByGuest; // guestName.index() -> booking slots, ascending
+    unordered_map<uint64_t, size_t> bookingsByReference;     // referenceID.key() -> slot of a confirmed booking
+    unordered_map<uint64_t, vector<size_t>> bookingsByGroup; // referenceID.key() of a group -> its slots
+
+    // Per-room interval index of dated bookings: checkIn -> checkOut,
+    // ordered by check-in and non-overlapping
+    unordered_map<int, map<int, int>> stays;
+    // Stays of loaded bookings that overlapped one already indexed: room,
+    // check-in, check-out. They are left out of stays and the night bitsets.
+    multiset<tuple<int, int, int>> overlappingStays;
+
+    // Bitsets over room positions, kept in step with rooms and stays
+    RoomBitset availableRooms;                     // Not held by a legacy booking
+    size_t availableCount = 0;
+    unordered_map<uint16_t, RoomBitset> roomsByType; // roomType.index() -> its rooms
+
+    // Rooms ordered by nightly price, which every quote is a multiple of,
+    // then room number: all of them, and those of each type
+    using PriceIndex = set<pair<int64_t, int>>;
+    PriceIndex roomsByPrice;
+    unordered_map<uint16_t, PriceIndex> roomsByTypeAndPrice; // roomType.index() -> its rooms
+    unordered_map<int, RoomBitset> occupiedOn;     // Night -> rooms with a stay that night
+
+    string dataDir; // Where the data files live; empty for the working directory
+    uint16_t property = 0;
+    StorageMode mode = StorageMode::Rewrite;
+    Durability durability = Durability::None;
+    size_t compactThreshold = 1000;
+    atomic<size_t> uncompacted{0}; // Records this process appended since its last compaction
+    bool snapshots = false;
+    unique_ptr<LockFile> locks;
+    Journal journal;
+    mutable shared_mutex stateLock; // Shared by readers, exclusive while the state changes
+    mutex compactionLock;           // Held by the thread compacting
+    mutex compactorLock;            // Guards the compactor thread object
+    thread compactor;
+    ShardLayout layout;                             // As of the last full read of the data files
+
+    // Every data file as this process last saw it, by shard (a single
+    // entry in the single-file layout)
+    struct DataStamps {
+        FileStamp layoutFile;
+        map<int, array<FileStamp, 2>> shards; // Rooms file, bookings file
+    };
+    DataStamps dataStamps;
+
+    // Journal mode, sharded layout: shards the records in the live log
+    // touch, so compaction rewrites only their files
+    set<int> journaledShards;
+
+    // Journal mode: where this thread's records go until its locks allow the write
+    inline static thread_local vector<string>* deferredRecords = nullptr;
+
+    // Rewrite mode: the shards whose rooms or bookings files need writing
+    // (shard 0 stands for rooms.txt/bookings.txt in the single-file layout).
+    // Inside withBatch() they pile up until the batch ends.
+    bool batching = false;
+    set<int> dirtyRoomShards, dirtyBookingShards;
+
+    // Rewrite mode, inside withRoom(): saves wait until its fn returns, and
+    // rooms it adds wait to be appended
+    bool deferring = false;
+    vector<Room> roomsToAppend;
+
+    // Persists one mutation of roomNumber's room or bookings according to the storage mode
+    void commit(const string& journalRecord, int roomNumber, bool roomsChanged, bool bookingsChanged) {
+        if (mode == StorageMode::Journal) {
+            noteJournaled(roomNumber);
+            record(journalRecord);
+            return;
+        }
+        if (roomsChanged) dirtyRoomShards.insert(shardKey(roomNumber));
+        if (bookingsChanged) dirtyBookingShards.insert(shardKey(roomNumber));
+        if (!batching && !deferring) saveDirty();
+    }
+
+    // Persists a change to the bookings of several rooms as one record
+    void commitGroup(const string& journalRecord, const vector<Booking>& members) {
+        if (mode == StorageMode::Journal) {
+            for (const Booking& b : members) noteJournaled(b.roomNumber);
+            record(journalRecord);
+            return;
+        }
+        for (const Booking& b : members) dirtyBookingShards.insert(shardKey(b.roomNumber));
+        if (!batching && !deferring) saveDirty();
+    }
+
+    // Rewrite mode: persists what a withRoom() update deferred. A room
+    // whose file is rewritten anyway is not appended to it as well. Like
+    // saveDirty(), a failed write reloads the files.
+    void saveDeferred() {
+        vector<Room> appended;
+        appended.swap(roomsToAppend);
+        try {
+            for (const Room& r : appended)
+                if (!dirtyRoomShards.count(shardKey(r.roomNumber))) appendRoom(r);
+        } catch (...) {
+            dirtyRoomShards.clear();
+            dirtyBookingShards.clear();
+            readDataFiles();
+            throw;
+        }
+        saveDirty();
+    }
+
+    // Path of one of the store's files in its data directory
+    string file(const string& name) const { return dataFile(dataDir, name); }
+
+    int shardKey(int roomNumber) const { return layout.sharded() ? layout.shardOf(roomNumber) : 0; }
+
+    void noteJournaled(int roomNumber) {
+        if (layout.sharded()) journaledShards.insert(layout.shardOf(roomNumber));
+    }
+
+    // Rewrite mode: writes the files marked dirty. If that fails the
+    // in-memory state goes back to what the files hold, so it never runs
+    // ahead of them; the caller holds the data files' lock exclusively.
+    void saveDirty() {
+        if (dirtyRoomShards.empty() && dirtyBookingShards.empty()) return;
+        try {
+            if (layout.sharded()) {
+                // Only the dirty shards' records are visited, so a save costs about one shard's worth
+                auto shardRooms = [&](auto fn) {
+                    for (int shard : dirtyRoomShards)
+                        forEachRoomNumberOf(shard, [&](int roomNumber) {
+                            if (const Room* r = roomAt(roomNumber)) fn(*r);
+                        });
+                };
+                auto shardBookings = [&](auto fn) {
+                    for (int shard : dirtyBookingShards)
+                        forEachRoomNumberOf(shard, [&](int roomNumber) {
+                            auto it = bookingsByRoom.find(roomNumber);
+                            if (it != bookingsByRoom.end())
+                                for (size_t slot : it->second) fn(bookings[slot]);
+                        });
+                };
+                saveShards(layout, shardRooms, shardBookings, &dirtyRoomShards, &dirtyBookingShards, syncWrites());
+            } else if (snapshots) {
+                // The snapshot covers both files, so it is rewritten with them
+                writeDataFiles(layout, rooms.toVector(), liveBookings(), nullptr, true, syncWrites());
+            } else {
+                if (!dirtyRoomShards.empty()) saveRooms(rooms.toVector(), syncWrites(), file("rooms.txt"));
+                if (!dirtyBookingShards.empty()) saveBookings(liveBookings(), syncWrites(), file("bookings.txt"));
+            }
+        } catch (...) {
+            dirtyRoomShards.clear();
+            dirtyBookingShards.clear();
+            readDataFiles();
+            throw;
+        }
+        set<int> written = dirtyRoomShards;
+        written.insert(dirtyBookingShards.begin(), dirtyBookingShards.end());
+        dirtyRoomShards.clear();
+        dirtyBookingShards.clear();
+        noteShardFiles(written);
+    }
+
+    // Calls fn with each room number of shard that has a room or bookings
+    // here, in ascending order. The shard's numbers are looked up one by one
+    // when there are fewer of them than indexed room numbers, so the cost
+    // follows the shard's size rather than the hotel's.
+    template <typename Fn>
+    void forEachRoomNumberOf(int shard, Fn fn) const {
+        auto present = [&](int roomNumber) {
+            if (roomIndex.count(roomNumber)) return true;
+            auto it = bookingsByRoom.find(roomNumber);
+            return it != bookingsByRoom.end() && !it->second.empty();
+        };
+        long long first = static_cast<long long>(shard) * layout.roomsPerShard;
+        if (static_cast<size_t>(layout.roomsPerShard) <= roomIndex.size() + bookingsByRoom.size()) {
+            for (long long n = first; n < first + layout.roomsPerShard; ++n)
+                if (present(static_cast<int>(n))) fn(static_cast<int>(n));
+            return;
+        }
+        set<int> numbers;
+        for (const auto& entry : roomIndex)
+            if (layout.shardOf(entry.first) == shard) numbers.insert(entry.first);
+        for (const auto& entry : bookingsByRoom)
+            if (layout.shardOf(entry.first) == shard && !entry.second.empty()) numbers.insert(entry.first);
+        for (int n : numbers) fn(n);
+    }
+
+    // Whether rewritten data files have to reach the disk before we go on
+    bool syncWrites() const { return durability != Durability::None; }
+
+    // compact() once this thread is the process's only compaction
+    bool compactLocked() {
+        waitForCompaction();
+
+        View copy; // What the rotated log leaves the data files at
+        set<int> shards; // Those the rotated log touches
+        int rotatedFd = -1; // Keeps the rotated log's inode from being reused while we compact it
+        {
+            // No process is writing while the rotation lock is held exclusively
+            RangeLock rotation(*locks, LOCK_JOURNAL_ROTATION, true);
+            unique_lock<shared_mutex> state(stateLock); // Readers in this process, too
+            catchUp();
+            uncompacted = 0;
+            {
+                // A log left by a crashed or still running compaction is
+                // already part of our state, as is the live one, so fold
+                // both in directly instead of rotating
+                RangeLock data(*locks, LOCK_DATA_FILES, true);
+                if (fileStamp(file(JOURNAL_COMPACTING_FILE)).exists()) {
+                    writeDataFiles(layout, rooms.toVector(), liveBookings(), nullptr, snapshots, syncWrites());
+                    dropJournals();
+                    journaledShards.clear();
+                    return true;
+                }
+            }
+            rotatedFd = ::open(file(JOURNAL_FILE).c_str(), O_RDONLY);
+            if (rotatedFd < 0) return true; // Nothing logged yet
+            if (rename(file(JOURNAL_FILE).c_str(), file(JOURNAL_COMPACTING_FILE).c_str()) != 0) {
+                ::close(rotatedFd);
+                throw runtime_error("Unable to rotate " + file(JOURNAL_FILE));
+            }
+            locks->setGeneration(locks->generation() + 1);
+            copy = viewLocked();
+            shards.swap(journaledShards);
+        }
+
+        lock_guard<mutex> guard(compactorLock);
+        compactor = thread([this, rotatedFd, copy = move(copy), shards = move(shards),
+                            layout = layout, withSnapshot = snapshots, sync = syncWrites()]() {
+            try {
+                RangeLock data(*locks, LOCK_DATA_FILES, true);
+                // Another process may have folded our log in the meantime and
+                // even rotated a newer one into its place; its data files are
+                // then more recent than our copy and must be left alone
+                string rotated = file(JOURNAL_COMPACTING_FILE);
+                struct stat ours, current;
+                bool stillOurs = fstat(rotatedFd, &ours) == 0 && ::stat(rotated.c_str(), &current) == 0 &&
+                                 ours.st_ino == current.st_ino && ours.st_dev == current.st_dev;
+                if (stillOurs) {
+                    writeDataFiles(layout, copy.allRooms().toVector(), copy.liveBookings(), &shards, withSnapshot, sync);
+                    remove(rotated.c_str());
+                }
+            } catch (const exception& e) {
+                cerr << "Journal compaction failed: " << e.what() << "\n";
+            }
+            ::close(rotatedFd);
+        });
+        return true;
+    }
+
+    // Compacts once the journal has grown past the threshold. Of several
+    // threads getting there together one compacts and the rest move on.
+    void compactIfDue() {
+        if (compactThreshold == 0 || uncompacted < compactThreshold) return;
+        unique_lock<mutex> one(compactionLock, try_to_lock);
+        if (one.owns_lock()) compactLocked();
+    }
+
+    // Applies what other processes journaled; the caller holds the rotation lock
+    void catchUp() {
+        if (!journal.catchUp([this](const string& record) { applyRecord(record); })) readJournaledState();
+    }
+
+    // Journal mode: a journal write failed after its change was made in
+    // memory, so the state is rebuilt from what reached the disk. Taking the
+    // rotation lock exclusively first lets every other writer that is
+    // between its own change and its write finish.
+    void discardUnwritten() {
+        RangeLock rotation(*locks, LOCK_JOURNAL_ROTATION, true);
+        unique_lock<shared_mutex> state(stateLock);
+        readJournaledState();
+    }
+
+    // Rebuilds the state from the data files and the logs not yet folded
+    // into them, and opens the live log. The caller holds the rotation lock.
+    // Returns true if a rotated log was still waiting to be compacted.
+    bool readJournaledState() {
+        waitForCompaction(); // Our own compactor may be about to rewrite the files
+        RangeLock data(*locks, LOCK_DATA_FILES, false);
+        readDataFiles();
+        journaledShards.clear();
+        auto apply = [this](const string& record) { applyRecord(record); };
+        bool leftover = Journal::replay(file(JOURNAL_COMPACTING_FILE), apply);
+        journal.open(file(JOURNAL_FILE), *locks);
+        journal.catchUp(apply);
+        return leftover;
+    }
+
+    // Deletes both logs once the data files hold everything in them.
+    // The caller holds the rotation lock exclusively and the data lock.
+    void dropJournals() {
+        remove(file(JOURNAL_COMPACTING_FILE).c_str());
+        remove(file(JOURNAL_FILE).c_str());
+        locks->setGeneration(locks->generation() + 1);
+    }
+
+    // Appends to the journal; a due compaction runs once the caller's locks are released
+    void record(const string& journalRecord) {
+        if (deferredRecords) {
+            deferredRecords->push_back(journalRecord);
+            return;
+        }
+        journal.waitDurable(appendRecords({journalRecord}));
+    }
+
+    // Returns the journal's ticket for the write
+    uint64_t appendRecords(const vector<string>& records) {
+        uint64_t ticket = journal.append(records);
+        uncompacted += records.size();
+        return ticket;
+    }
+
+    // Runs fn with the journal records it makes collected into records
+    template <typename Fn>
+    void collectRecords(vector<string>& records, Fn fn) {
+        deferredRecords = &records;
+        try {
+            fn();
+        } catch (...) {
+            deferredRecords = nullptr;
+            throw;
+        }
+        deferredRecords = nullptr;
+    }
+
+    // Runs fn with persistence deferred, then persists what it changed.
+    // Returns the journal's ticket for the write (0 in rewrite mode).
+    template <typename Fn>
+    uint64_t runBatched(Fn fn) {
+        vector<string> records;
+        batching = true;
+        try {
+            collectRecords(records, fn);
+        } catch (...) {
+            flushBatch(records);
+            throw;
+        }
+        return flushBatch(records);
+    }
+
+    uint64_t flushBatch(const vector<string>& records) {
+        batching = false;
+        if (mode == StorageMode::Journal) {
+            try {
+                return appendRecords(records);
+            } catch (...) {
+                readJournaledState(); // withBatch() holds the rotation lock exclusively, so no writer is in between
+                throw;
+            }
+        }
+        saveDirty();
+        return 0;
+    }
+
+    // Parses the data files (or a current snapshot) into a fresh state.
+    // Shard files are parsed in parallel; the snapshot only covers the
+    // single-file layout.
+    void readDataFiles() {
+        layout = ShardLayout::detect(dataDir);
+        if (layout.sharded()) {
+            auto loaded = loadShardFiles(layout, layout.shardsOnDisk());
+            rooms.clear();
+            bookings.clear();
+            for (auto& [shardRooms, shardBookings] : loaded) {
+                tag(shardRooms);
+                tag(shardBookings);
+                for (const auto& r : shardRooms) rooms.push_back(r);
+                for (const auto& b : shardBookings) bookings.push_back(b);
+            }
+        } else {
+            vector<Room> loadedRooms;
+            vector<Booking> loadedBookings;
+            if (!snapshots || !loadSnapshot(loadedRooms, loadedBookings, dataDir)) {
+                loadedRooms = loadRooms(file("rooms.txt"));
+                loadedBookings = loadBookings(file("bookings.txt"));
+                if (snapshots) saveSnapshot(loadedRooms, loadedBookings, dataDir); // Next start can skip the CSV parse
+            }
+            tag(loadedRooms);
+            tag(loadedBookings);
+            rooms.assign(loadedRooms);
+            bookings.assign(loadedBookings);
+        }
+        bookingLive.assign(bookings.size(), true);
+        deadBookings = 0;
+        rebuildRoomIndex();
+        rebuildBookingIndex();
+        noteDataFiles();
+    }
+
+    DataStamps readDataStamps() const {
+        DataStamps stamps;
+        stamps.layoutFile = fileStamp(file(SHARD_LAYOUT_FILE));
+        if (!layout.sharded()) {
+            stamps.shards[0] = {fileStamp(file("rooms.txt")), fileStamp(file("bookings.txt"))};
+            return stamps;
+        }
+        for (int shard : layout.shardsOnDisk())
+            stamps.shards[shard] = {fileStamp(layout.roomsPath(shard)), fileStamp(layout.bookingsPath(shard))};
+        return stamps;
+    }
+
+    // Remembers the data files as last read or written by this process
+    void noteDataFiles() { dataStamps = readDataStamps(); }
+
+    // Remembers the files of shards just written, without listing the
+    // shard directory again as noteDataFiles() does
+    void noteShardFiles(const set<int>& shards) {
+        for (int shard : shards) {
+            if (layout.sharded()) dataStamps.shards[shard] = {fileStamp(layout.roomsPath(shard)), fileStamp(layout.bookingsPath(shard))};
+            else dataStamps.shards[shard] = {fileStamp(file("rooms.txt")), fileStamp(file("bookings.txt"))};
+        }
+    }
+
+    // Rewrite mode: another process may have rewritten files since. In the
+    // sharded layout only the shards it rewrote are read again.
+    void reloadIfChanged() {
+        DataStamps current = readDataStamps();
+        if (current.layoutFile != dataStamps.layoutFile || !layout.sharded()) {
+            if (current.layoutFile != dataStamps.layoutFile || current.shards != dataStamps.shards) readDataFiles();
+            return;
+        }
+        set<int> changed;
+        for (const auto& [shard, stamps] : current.shards) {
+            auto seen = dataStamps.shards.find(shard);
+            if (seen == dataStamps.shards.end() || seen->second != stamps) changed.insert(shard);
+        }
+        for (const auto& entry : dataStamps.shards)
+            if (!current.shards.count(entry.first)) changed.insert(entry.first);
+        if (!changed.empty()) reloadShards(changed, current);
+    }
+
+    // Re-reads the files of the changed shards and keeps the rest of the
+    // state from memory, where it matches the files this process last saw.
+    // Only the changed shards' records are touched: their bookings are
+    // replaced, and their rooms updated in place (erasing a room reindexes
+    // them all, so only rooms gone from the files are erased).
+    void reloadShards(const set<int>& changed, const DataStamps& current) {
+        vector<int> shards(changed.begin(), changed.end());
+        auto loaded = loadShardFiles(layout, shards);
+        for (size_t i = 0; i < shards.size(); ++i) {
+            const auto& [fileRooms, fileBookings] = loaded[i];
+            vector<int> held;
+            forEachRoomNumberOf(shards[i], [&](int roomNumber) { held.push_back(roomNumber); });
+            for (int roomNumber : held) dropRoomBookings(roomNumber);
+
+            unordered_set<int> kept;
+            for (const Room& r : fileRooms) {
+                kept.insert(r.roomNumber);
+                if (roomAt(r.roomNumber)) replaceRoom(r);
+                else putRoom(r);
+            }
+            for (int roomNumber : held)
+                if (!kept.count(roomNumber)) eraseRoom(roomNumber);
+            for (const Booking& b : fileBookings) putBooking(b);
+        }
+        reclaimBookingSlots();
+        dataStamps = current;
+    }
+
+    // Rewrites the data files from the given state: all of them, or in the
+    // sharded layout those of shards when given. The snapshot is only kept
+    // for the single-file layout.
+    static void writeDataFiles(const ShardLayout& target, const vector<Room>& roomData, const vector<Booking>& bookingData,
+                               const set<int>* shards, bool withSnapshot, bool sync) {
+        if (target.sharded()) {
+            saveShards(target, [&](auto fn) { for (const auto& r : roomData) fn(r); },
+                       [&](auto fn) { for (const auto& b : bookingData) fn(b); }, shards, shards, sync);
+            return;
+        }
+        saveRooms(roomData, sync, target.file("rooms.txt"));
+        saveBookings(bookingData, sync, target.file("bookings.txt"));
+        if (withSnapshot) saveSnapshot(roomData, bookingData, target.base);
+    }
+
+    // Applies one journal record during replay
+    void applyRecord(const string& line) {
+        if (line.size() < 2 || line[1] != ',') throw runtime_error("Malformed journal record");
+        string body = line.substr(2);
+
+        switch (line[0]) {
+            case 'R': {
+                Room r = Room::deserialize(body);
+                noteJournaled(r.roomNumber);
+                if (roomAt(r.roomNumber)) replaceRoom(r);
+                else putRoom(r);
+                break;
+            }
+            case 'D':
+                noteJournaled(stoi(body));
+                eraseRoom(stoi(body));
+                break;
+            case 'B':
+                applyBooking(Booking::deserialize(body));
+                break;
+            case 'G': {
+                // G,<guest>,<nights>,<check-in>,<group reference>,<room>,<total>[,<room>,<total>...]
+                vector<string> fields;
+                FieldCursor cursor{body};
+                for (string_view f; cursor.next(f);) fields.emplace_back(f);
+                if (fields.size() < 6 || fields.size() % 2 != 0) throw runtime_error("Malformed group record");
+                Booking b;
+                b.guestName = fields[0];
+                b.nights = stoi(fields[1]);
+                if (!parseDate(fields[2], b.checkIn)) throw runtime_error("Malformed group record");
+                b.referenceID = fields[3];
+                for (size_t i = 4; i < fields.size(); i += 2) {
+                    b.roomNumber = stoi(fields[i]);
+                    if (!parseMoney(fields[i + 1], b.totalCost)) throw runtime_error("Malformed group record");
+                    applyBooking(b);
+                }
+                break;
+            }
+            case 'K': {
+                uint64_t key;
+                if (!ReferenceId::lookup(body, key)) break;
+                auto group = bookingsByGroup.find(key);
+                if (group == bookingsByGroup.end()) break;
+                for (size_t slot : group->second) noteJournaled(bookings[slot].roomNumber);
+                dropGroup(key);
+                break;
+            }
+            case 'C': {
+                size_t comma = body.find(',');
+                if (comma == string::npos) throw runtime_error("Malformed cancel record");
+                noteJournaled(stoi(body.substr(0, comma)));
+                long slot = findBookingSlot(body.substr(comma + 1), stoi(body.substr(0, comma)));
+                if (slot >= 0) dropBooking(slot);
+                reclaimBookingSlots();
+                break;
+            }
+            case 'X':
+                noteJournaled(stoi(body));
+                dropRoomBookings(stoi(body));
+                break;
+            default:
+                throw runtime_error("Unknown journal record type");
+        }
+    }
+
+    // Replays a booking record: the guest's booking for the room becomes b
+    void applyBooking(const Booking& b) {
+        noteJournaled(b.roomNumber);
+        long slot = findBookingSlot(b.guestName.index(), b.roomNumber);
+        if (slot >= 0) {
+            removeStay(bookings[slot]);
+            unindexReference(slot);
+            bookings.set(slot, tagged(b));
+            indexReference(slot);
+            addStay(b);
+        } else {
+            putBooking(b);
+        }
+    }
+
+    // A room or booking as kept here: tagged with the store's property
+    template <typename Record>
+    Record tagged(Record record) const {
+        record.property = property;
+        return record;
+    }
+
+    template <typename Record>
+    void tag(vector<Record>& records) const {
+        if (property != 0)
+            for (auto& record : records) record.property = property;
+    }
+
+    const Room* roomAt(int roomNumber) const {
+        auto it = roomIndex.find(roomNumber);
+        return it == roomIndex.end() ? nullptr : &rooms[it->second];
+    }
+
+    void putRoom(const Room& room) {
+        size_t position = rooms.size();
+        roomIndex[room.roomNumber] = position;
+        rooms.push_back(tagged(room));
+        indexRoom(position);
+        // A replayed log may have brought the room's stays in first
+        auto it = stays.find(room.roomNumber);
+        if (it != stays.end())
+            for (const auto& [checkIn, checkOut] : it->second) markNights(position, checkIn, checkOut);
+    }
+
+    // Overwrites an existing room, keeping the bitsets in step
+    void replaceRoom(const Room& room) {
+        size_t position = roomIndex.at(room.roomNumber);
+        unindexRoom(position);
+        rooms.set(position, tagged(room));
+        indexRoom(position);
+    }
+
+    bool eraseRoom(int roomNumber) {
+        auto it = roomIndex.find(roomNumber);
+        if (it == roomIndex.end()) return false;
+        rooms.erase(it->second);
+        rebuildRoomIndex(); // Deleting rooms is rare, so a reindex is acceptable
+        rebuildOccupancy(); // Positions after the deleted room have shifted
+        return true;
+    }
+
+    // Adds the room at position to the availability and type bitsets and
+    // the price indexes
+    void indexRoom(size_t position) {
+        const Room& r = rooms[position];
+        roomsByType[r.roomType.index()].set(position);
+        roomsByPrice.insert({r.price.cents(), r.roomNumber});
+        roomsByTypeAndPrice[r.roomType.index()].insert({r.price.cents(), r.roomNumber});
+        if (r.isAvailable) {
+            availableRooms.set(position);
+            ++availableCount;
+        }
+    }
+
+    void unindexRoom(size_t position) {
+        const Room& r = rooms[position];
+        auto type = roomsByType.find(r.roomType.index());
+        type->second.reset(position);
+        if (type->second.none()) roomsByType.erase(type);
+        roomsByPrice.erase({r.price.cents(), r.roomNumber});
+        auto priced = roomsByTypeAndPrice.find(r.roomType.index());
+        priced->second.erase({r.price.cents(), r.roomNumber});
+        if (priced->second.empty()) roomsByTypeAndPrice.erase(priced);
+        if (r.isAvailable) {
+            availableRooms.reset(position);
+            --availableCount;
+        }
+    }
+
+    // Rooms that are available, of roomType unless it is empty, and have
+    // no stay on any night of [checkIn, checkOut)
+    RoomBitset freeMask(int checkIn, int checkOut, const string& roomType) const {
+        RoomBitset free = availableRooms;
+        if (!roomType.empty()) {
+            uint16_t typeIndex;
+            if (!RoomType::lookup(roomType, typeIndex)) return RoomBitset();
+            auto type = roomsByType.find(typeIndex);
+            if (type == roomsByType.end()) return RoomBitset();
+            free.andWith(type->second);
+        }
+        for (int night = checkIn; night < checkOut; ++night) {
+            auto occupied = occupiedOn.find(night);
+            if (occupied != occupiedOn.end()) free.andNot(occupied->second);
+        }
+        return free;
+    }
+
+    void markNights(size_t position, int checkIn, int checkOut) {
+        for (int night = checkIn; night < checkOut; ++night) occupiedOn[night].set(position);
+    }
+
+    // Clears the nights of a removed stay that no remaining stay of the room covers
+    void unmarkNights(int roomNumber, const map<int, int>& spans, int checkIn, int checkOut) {
+        auto room = roomIndex.find(roomNumber);
+        if (room == roomIndex.end()) return;
+        for (int night = checkIn; night < checkOut; ++night) {
+            if (overlaps(spans, night, night + 1)) continue;
+            auto occupied = occupiedOn.find(night);
+            if (occupied == occupiedOn.end()) continue;
+            occupied->second.reset(room->second);
+            if (occupied->second.none()) occupiedOn.erase(occupied);
+        }
+    }
+
+    void rebuildOccupancy() {
+        occupiedOn.clear();
+        for (const auto& [roomNumber, spans] : stays) {
+            auto room = roomIndex.find(roomNumber);
+            if (room == roomIndex.end()) continue;
+            for (const auto& [checkIn, checkOut] : spans) markNights(room->second, checkIn, checkOut);
+        }
+    }
+
+    long findBookingSlot(const string& guestName, int roomNumber) const {
+        uint32_t guest;
+        if (!GuestName::lookup(guestName, guest)) return -1; // Nobody by that name has ever booked
+        return findBookingSlot(guest, roomNumber);
+    }
+
+    // Searches whichever of the room's and the guest's bookings is shorter
+    long findBookingSlot(uint32_t guest, int roomNumber) const {
+        auto byRoom = bookingsByRoom.find(roomNumber);
+        auto byGuest = bookingsByGuest.find(guest);
+        if (byRoom == bookingsByRoom.end() || byGuest == bookingsByGuest.end()) return -1;
+        if (byGuest->second.size() <= byRoom->second.size()) {
+            for (size_t slot : byGuest->second)
+                if (bookings[slot].roomNumber == roomNumber) return static_cast<long>(slot);
+        } else {
+            for (size_t slot : byRoom->second)
+                if (bookings[slot].guestName.index() == guest) return static_cast<long>(slot);
+        }
+        return -1;
+    }
+
+    void putBooking(const Booking& booking) {
+        bookingsByRoom[booking.roomNumber].push_back(bookings.size());
+        bookingsByGuest[booking.guestName.index()].push_back(bookings.size());
+        bookings.push_back(tagged(booking));
+        bookingLive.push_back(true);
+        indexReference(bookings.size() - 1);
+        addStay(booking);
+    }
+
+    void dropBooking(size_t slot) {
+        removeStay(bookings[slot]);
+        auto& slots = bookingsByRoom[bookings[slot].roomNumber];
+        slots.erase(find(slots.begin(), slots.end(), slot));
+        auto guest = bookingsByGuest.find(bookings[slot].guestName.index());
+        guest->second.erase(find(guest->second.begin(), guest->second.end(), slot));
+        if (guest->second.empty()) bookingsByGuest.erase(guest); // Most guests come and go
+        unindexReference(slot);
+        bookingLive.set(slot, false);
+        ++deadBookings;
+    }
+
+    // Unconfirmed bookings have no entry; the bookings of a group are
+    // indexed under the group's reference ID instead. Should a reference ID
+    // turn up on two bookings, the later one is indexed and dropping the
+    // earlier one leaves it alone.
+    void indexReference(size_t slot) {
+        ReferenceId referenceID = bookings[slot].referenceID;
+        if (referenceID.isGroup()) bookingsByGroup[referenceID.key()].push_back(slot);
+        else if (!referenceID.empty()) bookingsByReference[referenceID.key()] = slot;
+    }
+
+    void unindexReference(size_t slot) {
+        ReferenceId referenceID = bookings[slot].referenceID;
+        if (referenceID.isGroup()) {
+            auto group = bookingsByGroup.find(referenceID.key());
+            if (group == bookingsByGroup.end()) return;
+            auto& slots = group->second;
+            auto it = find(slots.begin(), slots.end(), slot);
+            if (it != slots.end()) slots.erase(it);
+            if (slots.empty()) bookingsByGroup.erase(group);
+            return;
+        }
+        auto it = bookingsByReference.find(referenceID.key());
+        if (it != bookingsByReference.end() && it->second == slot) bookingsByReference.erase(it);
+    }
+
+    // Drops every booking of the group with the given reference key
+    void dropGroup(uint64_t key) {
+        auto group = bookingsByGroup.find(key);
+        if (group == bookingsByGroup.end()) return;
+        vector<size_t> slots = group->second; // dropBooking() edits the index entry
+        for (size_t slot : slots) dropBooking(slot);
+        reclaimBookingSlots();
+    }
+
+    // Squeezes out tombstones once they make up most of the vector.
+    // Slot numbers change, so this only runs after a mutation is complete.
+    void reclaimBookingSlots() {
+        if (deadBookings > 1024 && deadBookings > bookings.size() / 2) compactBookings();
+    }
+
+    size_t dropRoomBookings(int roomNumber) {
+        auto it = bookingsByRoom.find(roomNumber);
+        if (it == bookingsByRoom.end()) return 0;
+        vector<size_t> slots = it->second;
+        for (size_t slot : slots) dropBooking(slot);
+        reclaimBookingSlots();
+        return slots.size();
+    }
+
+    vector<Booking> liveBookings() const {
+        vector<Booking> live;
+        live.reserve(bookingCount());
+        forEachBooking([&](const Booking& b) { live.push_back(b); });
+        return live;
+    }
+
+    // A view of the current state; the caller holds stateLock
+    View viewLocked() const {
+        View v;
+        v.rooms = rooms;
+        v.bookings = bookings;
+        v.bookingLive = bookingLive;
+        v.liveCount = bookingCount();
+        return v;
+    }
+
+    void compactBookings() {
+        bookings.assign(liveBookings());
+        bookingLive.assign(bookings.size(), true);
+        deadBookings = 0;
+        rebuildBookingIndex();
+    }
+
+    void rebuildRoomIndex() {
+        roomIndex.clear();
+        roomIndex.reserve(rooms.size());
+        availableRooms = RoomBitset();
+        availableCount = 0;
+        roomsByType.clear();
+        roomsByPrice.clear();
+        roomsByTypeAndPrice.clear();
+        for (size_t i = 0; i < rooms.size(); ++i) {
+            roomIndex[rooms[i].roomNumber] = i;
+            indexRoom(i);
+        }
+    }
+
+    void rebuildBookingIndex() {
+        bookingsByRoom.clear();
+        bookingsByGuest.clear();
+        bookingsByReference.clear();
+        bookingsByGroup.clear();
+        stays.clear();
+        overlappingStays.clear();
+        occupiedOn.clear();
+        for (size_t i = 0; i < bookings.size(); ++i) {
+            if (!bookingLive[i]) continue;
+            bookingsByRoom[bookings[i].roomNumber].push_back(i);
+            bookingsByGuest[bookings[i].guestName.index()].push_back(i);
+            indexReference(i);
+            addStay(bookings[i]);
+        }
+    }
+
+    // True if any span in spans overlaps [from, to)
+    static bool overlaps(const map<int, int>& spans, int from, int to) {
+        auto next = spans.lower_bound(from); // First stay starting on or after from
+        if (next != spans.end() && next->first < to) return true;
+        return next != spans.begin() && prev(next)->second > from;
+    }
+
+    void addStay(const Booking& b) {
+        if (!b.isDated()) return;
+        auto& spans = stays[b.roomNumber];
+        if (overlaps(spans, b.checkIn, b.checkOut())) {
+            // Only corrupt or hand-edited data gets here; the stay is kept
+            // out of the index so the other one still decides availability
+            cerr << "Warning: ignoring the stay of " << b.guestName << " in room " << b.roomNumber << " from "
+                 << formatDate(b.checkIn) << " to " << formatDate(b.checkOut()) << ": it overlaps another stay\n";
+            overlappingStays.emplace(b.roomNumber, b.checkIn, b.checkOut());
+            return;
+        }
+        spans.emplace(b.checkIn, b.checkOut());
+        auto room = roomIndex.find(b.roomNumber);
+        if (room != roomIndex.end()) markNights(room->second, b.checkIn, b.checkOut());
+    }
+
+    void removeStay(const Booking& b) {
+        if (!b.isDated()) return;
+        auto ignored = overlappingStays.find({b.roomNumber, b.checkIn, b.checkOut()});
+        if (ignored != overlappingStays.end()) { // Never indexed
+            overlappingStays.erase(ignored);
+            return;
+        }
+        auto it = stays.find(b.roomNumber);
+        if (it == stays.end()) return;
+        auto span = it->second.find(b.checkIn);
+        if (span != it->second.end() && span->second == b.checkOut()) {
+            it->second.erase(span);
+            unmarkNights(b.roomNumber, it->second, b.checkIn, b.checkOut());
+        }
+    }
+};
+
+// ----------------- Reports -----------------
+
+// Occupancy and revenue figures of one room type. Money is kept in whole
+// cents so that totals over millions of bookings are exact.
+struct TypeReport {
+    string roomType;
+    size_t rooms = 0, occupied = 0; // Occupied on the report's night
+    size_t bookings = 0, paidBookings = 0;
+    int64_t nights = 0;
+    int64_t revenueCents = 0, paidCents = 0;
+
+    void add(const TypeReport& other) {
+        rooms += other.rooms;
+        occupied += other.occupied;
+        bookings += other.bookings;
+        paidBookings += other.paidBookings;
+        nights += other.nights;
+        revenueCents += other.revenueCents;
+        paidCents += other.paidCents;
+    }
+};
+
+const char* const DELETED_ROOM_TYPE = "(deleted)"; // Group of bookings whose room no longer exists
+
+// Builds one report per room type (sorted by name, bookings of deleted
+// rooms last) in a single pass over the bookings, split across threads.
+// Each thread copies a block of bookings into plain columns and sums
+// them without branches, so that loop vectorizes; the thread totals are
+// then added up. It reads a view, so bookings carry on while it runs.
+vector<TypeReport> buildRevenueReport(const HotelStore::View& view, int night, size_t threads) {
+    vector<TypeReport> groups;
+    unordered_map<int, int32_t> roomGroup; // roomNumber -> index into groups
+    {
+        vector<string> types;
+        for (const auto& r : view.allRooms()) types.push_back(r.roomType);
+        sort(types.begin(), types.end());
+        types.erase(unique(types.begin(), types.end()), types.end());
+        for (const auto& type : types) groups.push_back({type});
+        groups.push_back({DELETED_ROOM_TYPE});
+    }
+    const int32_t deletedGroup = static_cast<int32_t>(groups.size() - 1);
+    const size_t groupCount = groups.size();
+    for (const auto& r : view.allRooms()) {
+        auto group = static_cast<int32_t>(lower_bound(groups.begin(), groups.end() - 1, r.roomType,
+            [](const TypeReport& g, const string& type) { return g.roomType < type; }) - groups.begin());
+        roomGroup[r.roomNumber] = group;
+        ++groups[group].rooms;
+    }
+
+    threads = max<size_t>(1, min(threads, view.bookingCount() / 16384 + 1));
+    vector<vector<TypeReport>> partials(threads, vector<TypeReport>(groupCount));
+    vector<vector<int>> staying(threads); // Rooms with a stay on the report's night, per slice
+    auto sumSlice = [&](size_t slice) {
+        const size_t BLOCK = 1024;
+        vector<int64_t> cents(BLOCK), nights(BLOCK), paid(BLOCK);
+        vector<int32_t> group(BLOCK);
+        size_t filled = 0;
+        auto flush = [&]() {
+            for (size_t g = 0; g < groupCount; ++g) {
+                int64_t count = 0, paidCount = 0, nightSum = 0, revenue = 0, paidRevenue = 0;
+                for (size_t i = 0; i < filled; ++i) {
+                    int64_t in = group[i] == static_cast<int32_t>(g);
+                    int64_t inPaid = in & paid[i];
+                    count += in;
+                    paidCount += inPaid;
+                    nightSum += in * nights[i];
+                    revenue += in * cents[i];
+                    paidRevenue += inPaid * cents[i];
+                }
+                TypeReport& total = partials[slice][g];
+                total.bookings += static_cast<size_t>(count);
+                total.paidBookings += static_cast<size_t>(paidCount);
+                total.nights += nightSum;
+                total.revenueCents += revenue;
+                total.paidCents += paidRevenue;
+            }
+            filled = 0;
+        };
+        view.forEachBookingInSlice(slice, threads, [&](const Booking& b) {
+            auto it = roomGroup.find(b.roomNumber);
+            cents[filled] = b.totalCost.cents();
+            nights[filled] = b.nights;
+            paid[filled] = !b.referenceID.empty();
+            group[filled] = it == roomGroup.end() ? deletedGroup : it->second;
+            if (b.isDated() && b.checkIn <= night && night < b.checkOut()) staying[slice].push_back(b.roomNumber);
+            if (++filled == BLOCK) flush();
+        });
+        flush();
+    };
+
+    vector<thread> workers;
+    for (size_t slice = 1; slice < threads; ++slice) workers.emplace_back(sumSlice, slice);
+    sumSlice(0);
+    for (auto& worker : workers) worker.join();
+
+    // A room is occupied if a legacy booking holds it or someone stays that night
+    unordered_set<int> occupied;
+    for (const auto& rooms : staying) occupied.insert(rooms.begin(), rooms.end());
+    for (const auto& r : view.allRooms())
+        if (!r.isAvailable || occupied.count(r.roomNumber)) ++groups[roomGroup[r.roomNumber]].occupied;
+
+    for (const auto& partial : partials)
+        for (size_t g = 0; g < groupCount; ++g) groups[g].add(partial[g]);
+    if (groups.back().bookings == 0) groups.pop_back(); // No bookings of deleted rooms
+    return groups;
+}
+
+// Prints occupancy for the given night, bookings, average length of
+// stay, and revenue split into paid (confirmed) and unpaid, per room type
+void printRevenueReport(const HotelStore& store, int night) {
+    STATS_TIME("revenueReport");
+    size_t threads = max(1u, thread::hardware_concurrency());
+    vector<TypeReport> groups = buildRevenueReport(store.view(), night, threads);
+    TypeReport total{"Total"};
+    for (const auto& g : groups) total.add(g);
+    groups.push_back(total);
+
+    cout << "\nOccupancy and revenue (occupancy on " << formatDate(night) << "):\n";
+    cout << left << setw(12) << "Type" << right << setw(8) << "Rooms" << setw(10) << "Occupied" << setw(8) << "Occ %"
+         << setw(11) << "Bookings" << setw(10) << "Avg stay" << setw(16) << "Revenue" << setw(16) << "Paid"
+         << setw(16) << "Unpaid" << setw(10) << "Unpaid #" << "\n";
+    for (const auto& g : groups) {
+        cout << left << setw(12) << g.roomType << right << setw(8) << g.rooms << setw(10) << g.occupied
+             << setw(7) << fixed << setprecision(1) << (g.rooms ? 100.0 * g.occupied / g.rooms : 0.0) << "%"
+             << setw(11) << g.bookings
+             << setw(10) << setprecision(2) << (g.bookings ? static_cast<double>(g.nights) / g.bookings : 0.0)
+             << setw(16) << formatCents(g.revenueCents) << setw(16) << formatCents(g.paidCents)
+             << setw(16) << formatCents(g.revenueCents - g.paidCents) << setw(10) << g.bookings - g.paidBookings << "\n";
+    }
+}
+
+// ----------------- Group Bookings -----------------
+
+// A group booking as asked for: one guest and stay, with rooms given by
+// number and as a number of rooms of a type for the hotel to pick
+struct GroupRequest {
+    string guest;
+    int checkIn = NO_DATE, nights = 0;
+    vector<int> rooms;
+    vector<pair<string, int>> roomsOfType; // Room type, how many
+};
+
+// Adds the rooms listed in text to request: room numbers and <type>:<count>
+// items separated by blanks ("101 102 Suite:3"). Throws runtime_error
+// with the reason if an item is malformed.
+void parseGroupRooms(const string& text, GroupRequest& request) {
+    istringstream in(text);
+    string item;
+    while (in >> item) {
+        size_t colon = item.find(':');
+        if (colon == string::npos) {
+            int roomNum;
+            if (!parseNumber(item, roomNum) || roomNum <= 0) throw runtime_error("invalid room number " + item);
+            request.rooms.push_back(roomNum);
+            continue;
+        }
+        string type = item.substr(0, colon);
+        int count;
+        if (!normalizeRoomType(type)) throw runtime_error("room type must be Single, Double or Suite");
+        if (!parseNumber(string_view(item).substr(colon + 1), count) || count < 1) throw runtime_error("invalid room count in " + item);
+        request.roomsOfType.push_back({type, count});
+    }
+    if (request.rooms.empty() && request.roomsOfType.empty()) throw runtime_error("no rooms given");
+}
+
+// Books every room of a group under one new group reference ID, or none
+// of them. All rooms are checked, and those asked for by type picked
+// cheapest first, before the first booking is made; the bookings are then
+// recorded as a single change. Run it inside HotelStore::withBatch(), so
+// that no other update comes between the checks and the write. Throws
+// runtime_error with the reason if the group cannot be booked as a whole.
+vector<Booking> bookGroup(HotelStore& store, const GroupRequest& request) {
+    STATS_TIME("bookGroup");
+    if (request.guest.empty()) throw runtime_error("guest name is empty");
+    if (request.checkIn == NO_DATE || request.checkIn < today()) throw runtime_error("check-in must not be in the past");
+    if (request.nights < 1 || request.nights > 30) throw runtime_error("nights must be 1 to 30");
+    int checkOut = request.checkIn + request.nights;
+
+    vector<const Room*> rooms;
+    unordered_set<int> chosen;
+    for (int roomNum : request.rooms) {
+        string room = "room " + to_string(roomNum);
+        const Room* r = store.findRoom(roomNum);
+        if (!r) throw runtime_error(room + " does not exist");
+        if (!chosen.insert(roomNum).second) throw runtime_error(room + " is listed twice");
+        if (store.findBooking(request.guest, roomNum)) throw runtime_error("guest already has a booking for " + room);
+        if (!store.isRoomFree(roomNum, request.checkIn, checkOut)) throw runtime_error(room + " is not available for those dates");
+        rooms.push_back(r);
+    }
+
+    // Rooms already picked or held by the guest come up in the search but
+    // cannot be taken, so ask for enough to get past all of them
+    size_t held = 0;
+    store.forEachBookingOf(request.guest, [&](const Booking&) { ++held; });
+    for (const auto& [type, count] : request.roomsOfType) {
+        RoomQuery query;
+        query.roomType = type;
+        query.checkIn = request.checkIn;
+        query.checkOut = checkOut;
+        query.limit = static_cast<size_t>(count) + chosen.size() + held;
+        int found = 0;
+        for (const Room* r : store.searchRooms(query)) {
+            if (found == count) break;
+            if (chosen.count(r->roomNumber) || store.findBooking(request.guest, r->roomNumber)) continue;
+            chosen.insert(r->roomNumber);
+            rooms.push_back(r);
+            ++found;
+        }
+        if (found < count)
+            throw runtime_error("only " + to_string(found) + " more " + type + " room(s) are free for those dates");
+    }
+
+    string groupReference = generateGroupReferenceID();
+    vector<Booking> members;
+    members.reserve(rooms.size());
+    for (const Room* r : rooms)
+        members.push_back({request.guest, r->roomNumber, request.nights,
+                           pricing().quote(*r, request.checkIn, request.nights), groupReference, request.checkIn});
+    store.addGroupBooking(members);
+    return members;
+}
+
+// Total cost of the bookings of a group
+Money groupTotal(const vector<Booking>& members) {
+    int64_t cents = 0;
+    for (const Booking& b : members) cents += b.totalCost.cents();
+    return Money::fromCents(cents);
+}
+
+// ----------------- User Base Class -----------------
+
+// Abstract base class for users (Guest or Admin)
 class User {
 protected:
-    string username; // User's name
+    string username;   // User's name
+    HotelStore& store; // Shared in-memory hotel data
+public:
+    User(const string& uname, HotelStore& hotel) : username(uname), store(hotel) {}
+    // Pure virtual function for displaying user-specific menu
+    virtual void showMenu() = 0;
+    virtual ~User() = default; // Virtual destructor for proper cleanup
+
+protected:
+    // Copies the booking confirmed under referenceID, or every booking of
+    // the group it names, into found; unless anyGuest is set, only the
+    // user's own bookings are found
+    bool lookUpReference(const string& referenceID, vector<Booking>& found, bool anyGuest) const {
+        return store.read([&]() {
+            found.clear();
+            auto take = [&](const Booking& b) {
+                if (anyGuest || b.guestName == username) found.push_back(b);
+            };
+            if (isGroupReferenceID(referenceID)) store.forEachBookingOfGroup(referenceID, take);
+            else if (const Booking* b = store.findBookingByReference(referenceID)) take(*b);
+            return !found.empty();
+        });
+    }
+
+    // Prompts for a reference ID, shows its booking and offers to cancel it
+    void findByReference(bool anyGuest) {
+        string referenceID;
+        cout << "Enter reference ID (e.g. REF1001): ";
+        cin >> referenceID;
+        if (!normalizeReferenceID(referenceID)) {
+            cout << "Invalid reference ID.\n";
+            return;
+        }
+
+        vector<Booking> found;
+        if (!lookUpReference(referenceID, found, anyGuest)) {
+            cout << "No confirmed booking found with Reference ID " << referenceID << ".\n";
+            return;
+        }
+        cout << "\nReference ID: " << referenceID;
+        for (const Booking& b : found)
+            cout << "\nGuest: " << b.guestName
+                 << ", Room " << b.roomNumber
+                 << ", Nights: " << b.nights
+                 << ", Total: $" << fixed << setprecision(2) << b.totalCost
+                 << ", Status: Paid" << describeStay(b);
+        cout << "\n";
+        if (found.size() > 1) cout << "Group total: $" << fixed << setprecision(2) << groupTotal(found) << "\n";
+
+        string answer;
+        while (true) {
+            if (found.size() == 1) cout << "Would you like to cancel this booking? (y/n): ";
+            else cout << "Would you like to cancel all " << found.size() << " bookings of this group? (y/n): ";
+            cin >> answer;
+            if (answer == "y" || answer == "Y" || answer == "n" || answer == "N") break;
+            cout << "Invalid input. Please enter 'y' or 'n'.\n";
+        }
+        if (answer == "y" || answer == "Y") cancelByReference(referenceID, anyGuest);
+    }
+
+    // Prompts for a check-in date (today or later) and a number of nights
+    void promptStay(int& checkIn, int& nights) {
+        string dateInput;
+        while (true) {
+            cout << "Enter check-in date (YYYY-MM-DD): ";
+            cin >> dateInput;
+            if (parseDate(dateInput, checkIn) && checkIn >= today()) break;
+            cout << "Invalid date. Use YYYY-MM-DD, today or later.\n";
+        }
+
+        string nightsInput;
+        while (true) {
+            cout << "Enter number of nights: ";
+            cin >> nightsInput;
+            stringstream ss(nightsInput);
+            if ((ss >> nights) && ss.eof() && nights > 0 && nights <= 30) break;
+            cout << "Invalid. Enter a positive number (1–30): ";
+        }
+    }
+
+    // Cancels the booking confirmed under referenceID, and only that one,
+    // or every booking of the group it names
+    void cancelByReference(const string& referenceID, bool anyGuest) {
+        vector<Booking> found;
+        if (!lookUpReference(referenceID, found, anyGuest)) {
+            cout << "No confirmed booking found with Reference ID " << referenceID << ".\n";
+            return;
+        }
+
+        if (isGroupReferenceID(referenceID)) {
+            // A group spans many rooms, so it is cancelled as one batch
+            store.withBatch([&]() {
+                size_t count = 0;
+                bool own = true;
+                store.forEachBookingOfGroup(referenceID, [&](const Booking& b) {
+                    ++count;
+                    own = own && (anyGuest || b.guestName == username);
+                });
+                if (count == 0 || !own) {
+                    cout << "No confirmed booking found with Reference ID " << referenceID << ".\n";
+                    return;
+                }
+                store.cancelGroup(referenceID);
+                cout << "Group " << referenceID << ": " << count << " booking(s) have been canceled.\n";
+            });
+            return;
+        }
+
+        // The booking may change before its room is locked, so look again under the lock
+        store.withRoom(found.front().roomNumber, [&]() {
+            const Booking* current = store.findBookingByReference(referenceID);
+            if (!current || (!anyGuest && current->guestName != username)) {
+                cout << "No confirmed booking found with Reference ID " << referenceID << ".\n";
+                return;
+            }
+            bool legacy = !current->isDated();
+            int roomNum = current->roomNumber;
+            store.cancelBookingByReference(referenceID);
+            if (legacy) store.setRoomAvailable(roomNum, true); // Legacy bookings hold the whole room
+            cout << "Booking " << referenceID << " for room " << roomNum << " has been canceled.\n";
+        });
+    }
+};
+
+// ----------------- Guest -----------------
+
+// Represents a guest user with booking-related functionality
+class Guest : public User {
+public:
+    Guest(const string& name, HotelStore& hotel) : User(name, hotel) {}
+
+    // Displays the guest menu and handles user interactions
+    void showMenu() override {
+        int choice;
+        do {
+            cout << "\n--- Guest Menu ---\n";
+            cout << "1. View Available Rooms\n2. Book a Room\n3. Cancel Booking\n4. View My Bookings\n5. Find Booking by Reference\n6. Exit\nChoice: ";
+            while (!(cin >> choice) || choice < 1 || choice > 6) {
+                cin.clear(); cin.ignore(numeric_limits<streamsize>::max(), '\n');
+                cout << "Invalid choice. Try again: ";
+            }
+
+            store.refresh(); // Pick up changes made by other front desks
+
+            switch (choice) {
+                case 1: viewAvailableRooms(); break;
+                case 2: bookRoom(); break;
+                case 3: cancelBooking(); break;
+                case 4: viewMyBookings(); break;
+                case 5: findMyBooking(); break;
+                case 6: cout << "Goodbye, " << username << "!\n"; break;
+            }
+        } while (choice != 6);
+    }
+
+    // Displays all rooms available for a requested stay
+    void viewAvailableRooms() {
+        STATS_TIME("guest.viewAvailableRooms");
+        int checkIn, nights;
+        promptStay(checkIn, nights);
+
+        cout << "\nAvailable Rooms:\n";
+        for (const Room* r : store.freeRooms(checkIn, checkIn + nights))
+            cout << "Room " << r->roomNumber << " (" << r->roomType << ")\n";
+
+        string summary;
+        for (const auto& [type, count] : store.freeRoomCounts(checkIn, checkIn + nights))
+            summary += (summary.empty() ? "" : ", ") + to_string(count) + " " + type;
+        if (!summary.empty()) cout << "Free: " << summary << "\n";
+    }
+
+    // Prints available rooms with their nightly price and the total for the stay
+    void printRoomPrices(const vector<const Room*>& rooms, int checkIn, int nights) {
+        vector<QuoteRequest> requests;
+        requests.reserve(rooms.size());
+        for (const Room* r : rooms) requests.push_back({r->price, checkIn, nights});
+        vector<double> totals;
+        pricing().quoteAll(requests, totals);
+
+        cout << "\nAvailable Rooms and Prices:\n";
+        cout << left << setw(12) << "Room No." << setw(12) << "Type" << setw(12) << "Price" << "Stay Total\n";
+        cout << "-----------------------------------------------------\n";
+        for (size_t i = 0; i < rooms.size(); ++i) {
+            stringstream nightly;
+            nightly << "$" << fixed << setprecision(2) << rooms[i]->price;
+            cout << left << setw(12) << rooms[i]->roomNumber
+                 << setw(12) << rooms[i]->roomType
+                 << setw(12) << nightly.str()
+                 << "$" << fixed << setprecision(2) << totals[i] << "\n";
+        }
+    }
+
+    // Handles room booking process
+    void bookRoom() {
+        STATS_TIME("guest.bookRoom");
+        // Ask for the stay first so only rooms free on those dates are offered
+        int checkIn, nights;
+        promptStay(checkIn, nights);
+        int checkOut = checkIn + nights;
+
+        // Show available rooms with prices
+        auto available = store.freeRooms(checkIn, checkOut);
+        printRoomPrices(available, checkIn, nights);
+
+        if (available.empty()) {
+            cout << "Sorry, no rooms are available for those dates.\n";
+            return;
+        }
+
+        // Select room, or let the hotel pick one
+        string roomInput;
+        int roomNum;
+        while (true) {
+            cout << "Enter room number to book, A to be assigned one (0 to return to menu): ";
+            cin >> roomInput;
+            if (roomInput == "A" || roomInput == "a") {
+                roomNum = assignRoom(checkIn, checkOut);
+                if (roomNum == 0) {
+                    cout << "No room matches what you asked for on those dates.\n";
+                    return;
+                }
+                cout << "You have been assigned Room " << roomNum << ".\n";
+                break;
+            }
+            stringstream ss(roomInput);
+            if ((ss >> roomNum) && ss.eof()) break;
+            cout << "Invalid input. Please enter a valid room number: ";
+        }
+
+        if (roomNum == 0) {
+            cout << "Returning to menu...\n";
+            return;
+        }
+
+        // Checks and booking run under the room's lock, so another front
+        // desk cannot take the room between the check and the write
+        store.withRoom(roomNum, [&]() {
+            // Check if room exists and is available for the stay
+            const Room* room = store.findRoom(roomNum);
+            if (!room || !store.isRoomFree(roomNum, checkIn, checkOut)) {
+                cout << "Room is not available or does not exist.\n";
+                return;
+            }
+
+            // Prevent double booking by the same guest
+            if (store.findBooking(username, roomNum)) {
+                cout << "You already have a booking for this room.\n";
+                return;
+            }
+
+            // Calculate cost and book
+            double cost = pricing().quote(*room, checkIn, nights);
+            Booking booking{username, roomNum, nights, cost, "", checkIn}; // Reference assigned on confirmation
+            store.addBooking(booking);
+
+            cout << "Booking successful!\nTotal cost for Room " << roomNum << ": $"
+                 << fixed << setprecision(2) << cost << " for " << nights << " night(s), "
+                 << formatDate(checkIn) << " to " << formatDate(checkOut) << ".\n";
+        });
+    }
+
+    // Asks for a room type and price limit and returns the cheapest room
+    // that matches, is free for [checkIn, checkOut) and is not already
+    // booked by this guest, or 0 if there is none. The limit holds for the
+    // stay as it will be charged, averaged over its nights.
+    int assignRoom(int checkIn, int checkOut) {
+        RoomQuery query;
+        query.checkIn = checkIn;
+        query.checkOut = checkOut;
+        while (true) {
+            cout << "Room type (Single, Double, Suite or Any): ";
+            cin >> query.roomType;
+            if (normalizeRoomType(query.roomType)) break;
+            if (query.roomType == "Any") {
+                query.roomType.clear();
+                break;
+            }
+            cout << "Invalid room type.\n";
+        }
+        string priceInput;
+        Money maxPrice;
+        while (true) {
+            cout << "Highest nightly price (0 for no limit): ";
+            cin >> priceInput;
+            if (parseMoney(priceInput, maxPrice) && maxPrice.cents() >= 0) break;
+            cout << "Invalid price.\n";
+        }
+        if (maxPrice.cents() > 0) query.maxCents = maxPrice.cents();
+
+        // Rooms this guest already holds are passed over, so ask for enough
+        // candidates that one of them is left. The search hands back
+        // pointers into the store, so they are only used under one read
+        return store.read([&]() {
+            size_t held = 0;
+            store.forEachBookingOf(username, [&](const Booking&) { ++held; });
+            query.limit = held + 1;
+            for (const Room* r : store.searchRooms(query))
+                if (!store.findBooking(username, r->roomNumber)) return r->roomNumber;
+            return 0;
+        });
+    }
+
+    // Cancels a booking for the current guest
+    void cancelBooking() {
+        STATS_TIME("guest.cancelBooking");
+        // Filter bookings for the current guest
+        vector<Booking> myBookings;
+        store.forEachBookingOf(username, [&](const Booking& b) { myBookings.push_back(b); });
+
+        if (myBookings.empty()) {
+            cout << "You have no bookings to cancel.\n";
+            return;
+        }
+
+        // Display guest's bookings
+        cout << "\nYour Current Bookings:\n";
+        for (const auto& b : myBookings) {
+            cout << "Guest: " << b.guestName
+                 << ", Room " << b.roomNumber
+                 << ", Nights: " << b.nights
+                 << ", Total: $" << fixed << setprecision(2) << b.totalCost
+                 << ", Status: " << (b.referenceID.empty() ? "Unpaid" : "Paid")
+                 << describeStay(b) << "\n";
+        }
+
+        // Get room number or reference ID to cancel
+        string input;
+        int roomNum;
+        cout << "Enter the room number or reference ID to cancel (0 to return to menu): ";
+        while (true) {
+            cin >> input;
+            if (normalizeReferenceID(input)) {
+                cancelByReference(input, false);
+                return;
+            }
+            stringstream ss(input);
+            if ((ss >> roomNum) && ss.eof()) break;
+            cout << "Invalid input. Enter a valid room number or reference ID (0 to cancel): ";
+        }
+
+        if (roomNum == 0) {
+            cout << "Returning to menu...\n";
+            return;
+        }
+
+        store.withRoom(roomNum, [&]() {
+            // Find and remove the booking
+            const Booking* existing = store.findBooking(username, roomNum);
+            bool legacy = existing && !existing->isDated();
+            if (!store.cancelBooking(username, roomNum)) {
+                cout << "No booking found under your name for room " << roomNum << ".\n";
+                return;
+            }
+
+            // Legacy bookings hold the whole room, so release it; dated stays
+            // simply leave the room's interval index
+            if (legacy) store.setRoomAvailable(roomNum, true);
+
+            cout << "Booking for room " << roomNum << " has been canceled.\n";
+        });
+    }
+
+    // Shows one of the guest's confirmed bookings by its reference ID
+    void findMyBooking() {
+        STATS_TIME("guest.findMyBooking");
+        findByReference(false);
+    }
+
+    // Displays and allows confirmation of guest's bookings
+    void viewMyBookings() {
+        STATS_TIME("guest.viewMyBookings");
+        bool found = false;
+
+        cout << "\n--- Your Bookings ---\n";
+        store.forEachBookingOf(username, [&](const Booking& b) {
+            cout << "Room " << b.roomNumber
+                 << ", Nights: " << b.nights
+                 << ", Cost: $" << fixed << setprecision(2) << b.totalCost
+                 << ", Status: " << (b.referenceID.empty() ? "Unpaid" : "Paid");
+            if (!b.referenceID.empty())
+                cout << ", Reference ID: " << b.referenceID;
+            cout << describeStay(b) << "\n";
+            found = true;
+        });
+
+        if (!found) {
+            cout << "You have no bookings.\n";
+            return;
+        }
+
+        // Ask if user wants to confirm a booking
+        string confirmInput;
+        char confirmChar;
+        while (true) {
+            cout << "\nWould you like to confirm a booking and receive a reference ID? (y/n): ";
+            cin >> confirmInput;
+            if (confirmInput.length() == 1) {
+                confirmChar = tolower(confirmInput[0]);
+                if (confirmChar == 'y' || confirmChar == 'n') break;
+            }
+            cout << "Invalid input. Please enter 'y' or 'n'.\n";
+        }
+
+        if (confirmChar != 'y') return;
+
+        // Get room number to confirm
+        string roomInput;
+        int roomNum;
+        while (true) {
+            cout << "Enter the room number to confirm: ";
+            cin >> roomInput;
+            stringstream ss(roomInput);
+            if ((ss >> roomNum) && (ss.eof())) break;
+            cout << "Invalid input. Enter a valid numeric room number: ";
+        }
+
+        // Update booking with reference ID
+        store.withRoom(roomNum, [&]() {
+            const Booking* b = store.findBooking(username, roomNum);
+            if (!b) {
+                cout << "No matching booking found to confirm.\n";
+                return;
+            }
+            if (!b->referenceID.empty()) {
+                cout << "This booking is already confirmed with Reference ID: " << b->referenceID << "\n";
+                return;
+            }
+
+            string referenceID = generateReferenceID();
+            store.confirmBooking(username, roomNum, referenceID);
+            cout << "Booking confirmed! Reference ID: " << referenceID << "\n";
+        });
+    }
+};
+
+// ----------------- Paged Listings -----------------
+
+const size_t DEFAULT_PAGE_SIZE = 20;
+
+// Appends an amount with two decimals, without going through a stream
+void appendMoney(string& out, double amount) {
+    char buf[32];
+    int n = snprintf(buf, sizeof buf, "%.2f", amount);
+    out.append(buf, static_cast<size_t>(max(n, 0)));
+}
+
+// Shows rowCount rows a page at a time. formatRow(index, out) appends row
+// index, newline included, to out; it is only called for the rows of the
+// page on screen, and each page reaches the terminal in a single write.
+// Between pages: Enter or n for the next page (past the last one ends the
+// listing), p for the previous one, a number to jump to that page, s <N>
+// to show N rows per page, q to stop. Call right after reading a menu
+// choice with cin >>, whose newline is still pending.
+template <typename FormatRow>
+void showPaged(size_t rowCount, FormatRow formatRow) {
+    if (rowCount == 0) return;
+    size_t pageSize = DEFAULT_PAGE_SIZE;
+    size_t page = 0;
+    bool prompted = false;
+    string out;
+    while (true) {
+        size_t pages = (rowCount + pageSize - 1) / pageSize;
+        page = min(page, pages - 1);
+        size_t first = page * pageSize, last = min(rowCount, first + pageSize);
+
+        {
+            STATS_TIME("console.page");
+            out.clear();
+            for (size_t i = first; i < last; ++i) formatRow(i, out);
+            if (pages > 1) {
+                out += "-- Page " + to_string(page + 1) + " of " + to_string(pages) + ", rows " + to_string(first + 1) +
+                       "-" + to_string(last) + " of " + to_string(rowCount) + " --\n";
+            }
+            cout.write(out.data(), static_cast<streamsize>(out.size()));
+            STATS_COUNT("console.bytesWritten", out.size());
+        }
+        if (pages == 1) return;
+
+        cout << "[Enter] next, p previous, <page>, s <rows per page>, q done: " << flush;
+        if (!prompted) cin.ignore(numeric_limits<streamsize>::max(), '\n');
+        prompted = true;
+        string command;
+        if (!getline(cin, command)) return;
+        vector<string> words;
+        stringstream ss(command);
+        for (string word; ss >> word;) words.push_back(word);
+
+        size_t number;
+        if (words.empty() || words[0] == "n") {
+            if (page + 1 == pages) return;
+            ++page;
+        } else if (words[0] == "p") {
+            if (page > 0) --page;
+        } else if (words[0] == "q") {
+            return;
+        } else if (words[0] == "s" && words.size() == 2 && parseNumber(words[1], number) && number > 0) {
+            pageSize = min<size_t>(number, 1000);
+            page = first / pageSize; // Keep the first row on screen
+        } else if (words.size() == 1 && parseNumber(words[0], number) && number >= 1 && number <= pages) {
+            page = number - 1;
+        } else {
+            cout << "Unknown command.\n";
+        }
+    }
+}
+
+// ----------------- Room Import -----------------
+
+// A rooms CSV for bulk import holds one room per line: <room>,<type>[,<price>].
+// Without a price the room gets its type's list price; with one, stays in
+// it are charged that price per night (see PricingEngine). A first line of
+// room,type or room,type,price (in any case) is taken as a header; blank
+// lines and lines starting with '#' are skipped. Imported rooms start out
+// available.
+
+// Outcome of an import: rooms added, and the rows turned down
+struct ImportReport {
+    size_t imported = 0;
+    vector<pair<size_t, string>> rejected; // Line number, reason; in line order
+};
+
+// Validates every row in one pass and adds the valid rooms as a single
+// batch, so the data files are written once (or one journal record goes
+// out) however many rooms there are. A row is rejected if its room number
+// is not positive, its type is not Single, Double or Suite, its price is
+// not a positive amount, or its room number was taken by an earlier row
+// or already exists; all of those are hash lookups.
+ImportReport importRooms(HotelStore& store, string_view text) {
+    STATS_TIME("importRooms");
+    const double maxPrice = 100000;
+    ImportReport report;
+    vector<pair<size_t, Room>> rows;
+    unordered_set<int> seen;
+
+    forEachLine(text, [&](string_view line, size_t lineNo) {
+        vector<string> fields;
+        FieldCursor cursor{line};
+        for (string_view f; cursor.next(f);) {
+            size_t first = f.find_first_not_of(" \t"), last = f.find_last_not_of(" \t");
+            fields.emplace_back(first == string_view::npos ? string_view() : f.substr(first, last - first + 1));
+        }
+        if (fields.size() == 1 && fields[0].empty()) return;
+        if (!fields[0].empty() && fields[0][0] == '#') return;
+        auto reject = [&](const string& reason) { report.rejected.push_back({lineNo, reason}); };
+
+        static const char* const header[] = {"room", "type", "price"};
+        if (lineNo == 1 && (fields.size() == 2 || fields.size() == 3) &&
+            equal(fields.begin(), fields.end(), header, [](const string& f, const char* name) { return strcasecmp(f.c_str(), name) == 0; }))
+            return;
+
+        Room r{0, "", 0.0, true};
+        string type = fields.size() > 1 ? fields[1] : "";
+        if (!parseNumber(fields[0], r.roomNumber)) return reject("invalid room number");
+        if (r.roomNumber <= 0) return reject("room number must be positive");
+        if (fields.size() < 2 || fields.size() > 3) return reject("expected <room>,<type>[,<price>]");
+        if (!normalizeRoomType(type)) return reject("room type must be Single, Double or Suite");
+        r.roomType = type;
+        if (fields.size() == 3) {
+            if (!parseMoney(fields[2], r.price) || !(r.price > 0) || r.price > maxPrice)
+                return reject("price must be a positive amount up to 100000");
+        } else {
+            r.price = roomListPrice(r.roomType);
+        }
+        if (!seen.insert(r.roomNumber).second) return reject("room " + to_string(r.roomNumber) + " is already on an earlier line");
+        rows.push_back({lineNo, r});
+    });
+
+    store.withBatch([&]() {
+        for (const auto& [lineNo, room] : rows) {
+            if (store.addRoom(room)) ++report.imported;
+            else report.rejected.push_back({lineNo, "room " + to_string(room.roomNumber) + " already exists"});
+        }
+    });
+    sort(report.rejected.begin(), report.rejected.end());
+    return report;
+}
+
+// Imports the rooms CSV at path ("-" for standard input) and prints
+//   <line>,error,<reason>
+// for every rejected row, then a summary on standard error. Returns the
+// number of rejected rows.
+size_t runRoomImport(HotelStore& store, const string& path) {
+    string text;
+    if (path == "-") {
+        text.assign(istreambuf_iterator<char>(cin), istreambuf_iterator<char>());
+    } else {
+        MappedFile file(path);
+        text = string(file.view());
+    }
+
+    ImportReport report = importRooms(store, text);
+    string out;
+    for (const auto& [lineNo, reason] : report.rejected) out += to_string(lineNo) + ",error," + reason + "\n";
+    cout << out;
+    cerr << report.imported << " rooms imported, " << report.rejected.size() << " rows rejected\n";
+    return report.rejected.size();
+}
+
+// ----------------- Admin -----------------
+
+// Represents an admin user with management functionality
+class Admin : public User {
 public:
-    User(const string& uname) : username(uname) {}
-    // Pure virtual function for displaying user-specific menu
-    virtual void showMenu() = 0;
-    virtual ~User() = default; // Virtual destructor for proper cleanup
+    Admin(const string& name, HotelStore& hotel) : User(name, hotel) {}
+
+    // Displays the admin menu and handles user interactions
+    void showMenu() override {
+        int choice;
+        do {
+            cout << "\n--- Admin Menu ---\n";
+            cout << "1. View All Rooms\n2. View All Bookings\n3. Add Room\n4. Delete Room\n5. Update Room Type\n6. Cancel Any Booking\n7. Occupancy & Revenue Report\n8. Compact Storage\n9. Statistics\n10. Find Booking by Reference\n11. Import Rooms from CSV\n12. Group Booking\n13. Logout\nChoice: ";
+            while (!(cin >> choice) || choice < 1 || choice > 13) {
+                cin.clear(); cin.ignore(numeric_limits<streamsize>::max(), '\n');
+                cout << "Invalid choice. Try again: ";
+            }
+
+            store.refresh(); // Pick up changes made by other front desks
+
+            switch (choice) {
+                case 1: viewAllRooms(); break;
+                case 2: viewAllBookings(); break;
+                case 3: addRoom(); break;
+                case 4: deleteRoom(); break;
+                case 5: updateRoomType(); break;
+                case 6: cancelAnyBooking(); break;
+                case 7: printRevenueReport(store, today()); break;
+                case 8: compactStorage(); break;
+                case 9: showStatistics(); break;
+                case 10: findAnyBooking(); break;
+                case 11: importRoomsFromFile(); break;
+                case 12: bookGroupRooms(); break;
+                case 13: cout << "Logging out...\n"; break;
+            }
+        } while (choice != 13);
+    }
+
+    // Displays the timers and counters collected since start-up
+    void showStatistics() {
+#if HOTEL_STATS
+        cout << "\nStatistics since start-up:\n";
+        stats().print(cout);
+#else
+        cout << "Statistics were compiled out of this build (HOTEL_STATS=0).\n";
+#endif
+    }
+
+    // Displays all rooms, including availability
+    void viewAllRooms() {
+        STATS_TIME("admin.viewAllRooms");
+        cout << "\nAll Rooms:\n";
+        pageRooms();
+    }
+
+    // Displays all bookings in the system
+    void viewAllBookings() {
+        STATS_TIME("admin.viewAllBookings");
+        cout << "\nAll Bookings:\n";
+        pageBookings();
+    }
+
+    // Adds a new room to the system
+    void addRoom() {
+        STATS_TIME("admin.addRoom");
+        const auto& rooms = store.allRooms();
+
+        // Display current rooms
+        cout << "\n--- Current Rooms in the System ---\n";
+        if (rooms.empty()) {
+            cout << "No rooms found.\n";
+        } else {
+            pageRooms();
+        }
+
+        // Get new room number
+        int num;
+        cout << "\nEnter new room number (0 to cancel): ";
+        while (!(cin >> num) || num < 0) {
+            cin.clear(); cin.ignore(numeric_limits<streamsize>::max(), '\n');
+            cout << "Invalid input. Enter a valid room number (0 to cancel): ";
+        }
+
+        if (num == 0) {
+            cout << "Room addition cancelled.\n";
+            return;
+        }
+
+        // Check for duplicate room number
+        if (store.findRoom(num)) {
+            cout << "Room number already exists. Cannot add duplicate.\n";
+            return;
+        }
+
+        // Get room type
+        cin.ignore();
+        string type;
+        while (true) {
+            cout << "Enter room type (Single/Double/Suite): ";
+            getline(cin, type);
+            if (normalizeRoomType(type)) break;
+            cout << "Invalid room type. Please enter Single, Double, or Suite.\n";
+        }
+
+        // Assign price based on type
+        double price = roomListPrice(type);
+
+        Room newRoom = { num, type, price, true }; // New room is available by default
+
+        store.withRoom(num, [&]() {
+            try {
+                // Another admin may have added the same number meanwhile
+                if (!store.addRoom(newRoom)) {
+                    cout << "Room number already exists. Cannot add duplicate.\n";
+                    return;
+                }
+            } catch (const exception&) {
+                cout << "Error opening rooms.txt for writing.\n";
+                return;
+            }
+
+            cout << "Room added successfully.\n";
+        });
+    }
+
+    // Deletes a room from the system
+    void deleteRoom() {
+        STATS_TIME("admin.deleteRoom");
+        const auto& rooms = store.allRooms();
+
+        // Display current rooms
+        cout << "\n--- Current Rooms in the System ---\n";
+        if (rooms.empty()) {
+            cout << "No rooms found.\n";
+            return;
+        }
+
+        pageRooms();
+
+        // Get room number to delete
+        int num;
+        cout << "\nEnter room number to delete (0 to cancel): ";
+        while (!(cin >> num) || num < 0) {
+            cin.clear(); cin.ignore(numeric_limits<streamsize>::max(), '\n');
+            cout << "Invalid. Enter a valid room number (0 to cancel): ";
+        }
+
+        if (num == 0) {
+            cout << "Deletion cancelled. Returning to menu...\n";
+            return;
+        }
+
+        store.withRoom(num, [&]() {
+            // Check if room has active bookings
+            if (store.hasBookingForRoom(num)) {
+                cout << "Cannot delete room " << num << " because it has an active booking.\n";
+                return;
+            }
+
+            // Remove room
+            if (store.removeRoom(num)) {
+                cout << "Room " << num << " deleted successfully.\n";
+            } else {
+                cout << "Room number not found. Nothing deleted.\n";
+            }
+        });
+    }
+
+    // Updates the type and price of an existing room
+    void updateRoomType() {
+        STATS_TIME("admin.updateRoomType");
+        const auto& rooms = store.allRooms();
+
+        // Display all rooms
+        cout << "\n--- Current Rooms in the System ---\n";
+        if (rooms.empty()) {
+            cout << "No rooms available to update.\n";
+            return;
+        }
+
+        pageRooms();
+
+        // Get room number
+        string input;
+        int num;
+        while (true) {
+            cout << "\nEnter room number to update (0 to cancel): ";
+            cin >> input;
+            stringstream ss(input);
+            if ((ss >> num) && ss.eof() && num >= 0) break;
+            cout << "Invalid input. Enter a valid room number (0 to cancel): ";
+        }
+
+        if (num == 0) {
+            cout << "Update cancelled. Returning to menu...\n";
+            return;
+        }
+
+        // Find room
+        if (!store.findRoom(num)) {
+            cout << "Room number not found.\n";
+            return;
+        }
+
+        // Get new room type
+        cin.ignore();
+        string type;
+        while (true) {
+            cout << "Enter new room type (Single/Double/Suite): ";
+            getline(cin, type);
+            if (normalizeRoomType(type)) break;
+            cout << "Invalid room type. Please enter Single, Double, or Suite.\n";
+        }
+
+        // Update room type and price
+        double price = roomListPrice(type);
+
+        store.withRoom(num, [&]() {
+            if (!store.updateRoom(num, type, price)) {
+                cout << "Room number not found.\n";
+                return;
+            }
+            cout << "Room " << num << " type updated successfully to " << type
+                 << " with new price $" << fixed << setprecision(2) << price << ".\n";
+        });
+    }
+
+    // Cancels any booking in the system
+    void cancelAnyBooking() {
+        STATS_TIME("admin.cancelAnyBooking");
+        if (store.bookingCount() == 0) {
+            cout << "\nNo bookings found to cancel.\n";
+            return;
+        }
+
+        // Display all bookings
+        cout << "\n--- Current Bookings ---\n";
+        pageBookings();
+
+        // Get room number or reference ID to cancel; a reference ID cancels
+        // just that booking, a room number every booking of the room
+        string input;
+        int roomNum;
+        cout << "\nEnter room number or reference ID to cancel booking (0 to cancel): ";
+        while (true) {
+            cin >> input;
+            if (normalizeReferenceID(input)) {
+                cancelByReference(input, true);
+                return;
+            }
+            stringstream ss(input);
+            if ((ss >> roomNum) && ss.eof() && roomNum >= 0) break;
+            cout << "Invalid input. Enter a valid room number or reference ID (0 to cancel): ";
+        }
+
+        if (roomNum == 0) {
+            cout << "Cancellation aborted. Returning to menu...\n";
+            return;
+        }
+
+        // Remove booking
+        store.withRoom(roomNum, [&]() {
+            if (store.cancelRoomBookings(roomNum) > 0) {
+                store.setRoomAvailable(roomNum, true);
+                cout << "Booking for room " << roomNum << " canceled successfully.\n";
+            } else {
+                cout << "No booking found for room number " << roomNum << ".\n";
+            }
+        });
+    }
+
+    // Adds every room listed in a CSV file in one go and lists the rows that were rejected
+    void importRoomsFromFile() {
+        STATS_TIME("admin.importRooms");
+        string path;
+        cout << "Enter the path of the rooms CSV (<room>,<type>[,<price>] per line): ";
+        cin >> path;
+
+        ImportReport report;
+        try {
+            MappedFile file(path);
+            report = importRooms(store, file.view());
+        } catch (const exception& e) {
+            cout << "Import failed: " << e.what() << "\n";
+            return;
+        }
+
+        cout << report.imported << " room(s) imported, " << report.rejected.size() << " row(s) rejected.\n";
+        showPaged(report.rejected.size(), [&](size_t i, string& out) {
+            out += "Line " + to_string(report.rejected[i].first) + ": " + report.rejected[i].second + "\n";
+        });
+    }
+
+    // Books rooms for a tour group or conference in one go: either every
+    // room asked for is booked, under one group reference ID, or none is
+    void bookGroupRooms() {
+        STATS_TIME("admin.bookGroup");
+        GroupRequest request;
+        cout << "Enter the guest name to book the group under: ";
+        cin.ignore(numeric_limits<streamsize>::max(), '\n');
+        getline(cin, request.guest);
+        if (request.guest.empty()) {
+            cout << "Name cannot be empty.\n";
+            return;
+        }
+        promptStay(request.checkIn, request.nights);
+        cin.ignore(numeric_limits<streamsize>::max(), '\n');
+        string rooms;
+        cout << "Enter the rooms by number and as <type>:<count> (e.g. 101 102 Suite:3): ";
+        getline(cin, rooms);
+
+        vector<Booking> members;
+        try {
+            parseGroupRooms(rooms, request);
+            store.withBatch([&]() { members = bookGroup(store, request); });
+        } catch (const exception& e) {
+            cout << "Group not booked, no room was taken: " << e.what() << "\n";
+            return;
+        }
+
+        cout << "Group booked! Reference ID: " << members.front().referenceID << "\n";
+        for (const Booking& b : members)
+            cout << "Room " << b.roomNumber << ": $" << fixed << setprecision(2) << b.totalCost << "\n";
+        cout << members.size() << " room(s), " << formatDate(request.checkIn) << " to "
+             << formatDate(request.checkIn + request.nights) << ", total $" << fixed << setprecision(2)
+             << groupTotal(members) << "\n";
+    }
+
+    // Shows any guest's confirmed booking by its reference ID
+    void findAnyBooking() {
+        STATS_TIME("admin.findAnyBooking");
+        findByReference(true);
+    }
+
+    // Folds the booking journal back into the data files
+    void compactStorage() {
+        STATS_TIME("admin.compactStorage");
+        try {
+            if (!store.compact()) {
+                cout << "Journaling is off; data files are already up to date.\n";
+                return;
+            }
+            store.waitForCompaction();
+            cout << "Storage compacted.\n";
+        } catch (const exception& e) {
+            cout << "Compaction failed: " << e.what() << "\n";
+        }
+    }
+
+private:
+    // Lists the rooms a page at a time, as they were when the listing
+    // started. A room is "Occupied" if a legacy booking holds it or it has
+    // a stay tonight.
+    void pageRooms() const {
+        HotelStore::View view = store.view(today());
+        const auto& rooms = view.allRooms();
+        showPaged(rooms.size(), [&](size_t i, string& out) {
+            const Room& r = rooms[i];
+            out += "Room " + to_string(r.roomNumber) + " (" + r.roomType.str() + ") - " +
+                   (view.isOccupied(i) ? "Occupied" : "Available") + "\n";
+        });
+    }
+
+    // Lists the bookings a page at a time, as they were when the listing started
+    void pageBookings() const {
+        HotelStore::View view = store.view();
+        HotelStore::View::BookingCursor cursor;
+        showPaged(view.bookingCount(), [&](size_t i, string& out) {
+            const Booking& b = view.bookingAt(i, cursor);
+            out += "Guest: " + b.guestName.str() + ", Room " + to_string(b.roomNumber) + ", Nights: " + to_string(b.nights) +
+                   ", Total: $";
+            appendMoney(out, b.totalCost);
+            out += b.referenceID.empty() ? ", Status: Unpaid" : ", Status: Paid";
+            out += describeStay(b) + "\n";
+        });
+    }
 };
 
-// ----------------- Guest -----------------
+// ----------------- Login -----------------
+
+// Handles user login and returns appropriate User object
+User* login(HotelStore& store) {
+    int choice;
+    cout << "\nLogin as:\n1. Admin\n2. Guest\nChoice: ";
+    while (!(cin >> choice) || (choice != 1 && choice != 2)) {
+        cin.clear(); cin.ignore(numeric_limits<streamsize>::max(), '\n');
+        cout << "Invalid. Enter 1 for Admin, 2 for Guest: ";
+    }
+
+    string name, pass;
+    cin.ignore();
 
-// Represents a guest user with booking-related functionality
-class Guest : public User {
-public:
-    Guest(const string& name) : User(name) {}
+    if (choice == 1) {
+        cout << "Username: "; getline(cin, name);
+        cout << "Password: "; getline(cin, pass);
+        if (name == "admin" && pass == "123") return new Admin(name, store);
+        else cout << "Invalid credentials.\n";
+    } else {
+        cout << "Enter your name: ";
+        getline(cin, name);
+        if (!name.empty()) return new Guest(name, store);
+        else cout << "Name cannot be empty.\n";
+    }
 
-    // Displays the guest menu and handles user interactions
-    void showMenu() override {
-        int choice;
-        do {
-            cout << "\n--- Guest Menu ---\n";
-            cout << "1. View Available Rooms\n2. Book a Room\n3. Cancel Booking\n4. View My Bookings\n5. Exit\nChoice: ";
-            while (!(cin >> choice) || choice < 1 || choice > 5) {
-                cin.clear(); cin.ignore(numeric_limits<streamsize>::max(), '\n');
-                cout << "Invalid choice. Try again: ";
-            }
+    return nullptr;
+}
 
-            switch (choice) {
-                case 1: viewAvailableRooms(); break;
-                case 2: bookRoom(); break;
-                case 3: cancelBooking(); break;
-                case 4: viewMyBookings(); break;
-                case 5: cout << "Goodbye, " << username << "!\n"; break;
-            }
-        } while (choice != 5);
+// ----------------- Batch Mode -----------------
+
+// Batch files hold one command per line, with comma-separated fields like
+// the data files. Blank lines and lines starting with '#' are skipped.
+//   book,<guest>,<room>,<YYYY-MM-DD>,<nights>
+//   cancel,<guest>,<room>
+//   confirm,<guest>,<room>
+//   find,<reference ID>
+//   cancel-ref,<reference ID>                   (a group reference ID cancels the whole group)
+//   group,<guest>,<YYYY-MM-DD>,<nights>,<rooms> (rooms: "101 102 Suite:3"; all are booked or none)
+//   add-room,<room>,<type>
+//   delete-room,<room>
+//   update-type,<room>,<type>
+
+// Splits a command line into fields with surrounding blanks trimmed
+vector<string> splitCommand(string_view line) {
+    vector<string> fields;
+    FieldCursor cursor{line};
+    string_view f;
+    while (cursor.next(f)) {
+        size_t first = f.find_first_not_of(" \t");
+        size_t last = f.find_last_not_of(" \t");
+        fields.emplace_back(first == string_view::npos ? string_view() : f.substr(first, last - first + 1));
     }
+    return fields;
+}
 
-    // Displays all available rooms
-    void viewAvailableRooms() {
-        auto rooms = loadRooms();
-        cout << "\nAvailable Rooms:\n";
-        for (const auto& r : rooms)
-            if (r.isAvailable)
-                cout << "Room " << r.roomNumber << " (" << r.roomType << ")\n";
+// Formats an amount the way the data files store it
+string formatMoney(double amount) {
+    stringstream ss;
+    ss << fixed << setprecision(2) << amount;
+    return ss.str();
+}
+
+// Parses the room number field of a batch command
+int batchRoomNumber(const string& field) {
+    int roomNum;
+    if (!parseNumber(field, roomNum) || roomNum <= 0) throw runtime_error("invalid room number");
+    return roomNum;
+}
+
+// Reads a room search, <YYYY-MM-DD>,<nights>[,<type>[,<max price>[,<limit>]]],
+// from fields[first] on. An empty type means any; an empty max price or
+// one of 0, or an empty limit, means no limit.
+// Throws runtime_error with the reason if a field is malformed.
+RoomQuery parseRoomSearch(const vector<string>& fields, size_t first) {
+    size_t count = fields.size() - min(first, fields.size());
+    if (count < 2 || count > 5) throw runtime_error("expected 2 to 5 arguments");
+    int checkIn, nights;
+    if (!parseDate(fields[first], checkIn)) throw runtime_error("check-in must be YYYY-MM-DD");
+    if (!parseNumber(fields[first + 1], nights) || nights < 1 || nights > 30) throw runtime_error("nights must be 1 to 30");
+    RoomQuery query;
+    query.checkIn = checkIn;
+    query.checkOut = checkIn + nights;
+    if (count > 2 && !fields[first + 2].empty()) {
+        query.roomType = fields[first + 2];
+        if (!normalizeRoomType(query.roomType)) throw runtime_error("room type must be Single, Double or Suite");
+    }
+    if (count > 3 && !fields[first + 3].empty()) {
+        Money maxPrice;
+        if (!parseMoney(fields[first + 3], maxPrice) || maxPrice.cents() < 0) throw runtime_error("invalid max price");
+        if (maxPrice.cents() > 0) query.maxCents = maxPrice.cents();
     }
+    if (count > 4 && !fields[first + 4].empty()) {
+        int limit;
+        if (!parseNumber(fields[first + 4], limit) || limit < 1) throw runtime_error("limit must be a positive number");
+        query.limit = static_cast<size_t>(limit);
+    }
+    return query;
+}
 
-    // Prints available rooms with their prices
-    void printRoomPrices(const vector<Room>& rooms) {
-        cout << "\nAvailable Rooms and Prices:\n";
-        cout << left << setw(12) << "Room No." << setw(12) << "Type" << setw(12) << "Price\n";
-        cout << "-----------------------------------------\n";
-        for (const auto& r : rooms) {
-            if (r.isAvailable) {
-                cout << left << setw(12) << r.roomNumber
-                     << setw(12) << r.roomType
-                     << "$" << fixed << setprecision(2) << r.price << "\n";
-            }
-        }
+// Runs one batch command and returns its result detail (empty if it has
+// none). Throws runtime_error with the reason if the command is rejected,
+// in which case nothing was changed. Applies the same checks as the menus.
+string runBatchCommand(HotelStore& store, const vector<string>& fields) {
+    const string& command = fields[0];
+    auto expectFields = [&](size_t count) {
+        if (fields.size() != count) throw runtime_error("expected " + to_string(count - 1) + " arguments");
+    };
+
+    if (command == "book") {
+        expectFields(5);
+        const string& guest = fields[1];
+        int roomNum = batchRoomNumber(fields[2]);
+        int checkIn, nights;
+        if (guest.empty()) throw runtime_error("guest name is empty");
+        if (!parseDate(fields[3], checkIn) || checkIn < today()) throw runtime_error("check-in must be YYYY-MM-DD and not in the past");
+        if (!parseNumber(fields[4], nights) || nights < 1 || nights > 30) throw runtime_error("nights must be 1 to 30");
+
+        const Room* room = store.findRoom(roomNum);
+        if (!room) throw runtime_error("room does not exist");
+        if (store.findBooking(guest, roomNum)) throw runtime_error("guest already has a booking for this room");
+        if (!store.isRoomFree(roomNum, checkIn, checkIn + nights)) throw runtime_error("room is not available for those dates");
+
+        double cost = pricing().quote(*room, checkIn, nights);
+        store.addBooking({guest, roomNum, nights, cost, "", checkIn});
+        return formatMoney(cost);
     }
 
-    // Handles room booking process
-    void bookRoom() {
-        auto rooms = loadRooms();
-        auto bookings = loadBookings();
+    if (command == "cancel") {
+        expectFields(3);
+        int roomNum = batchRoomNumber(fields[2]);
+        const Booking* existing = store.findBooking(fields[1], roomNum);
+        if (!existing) throw runtime_error("no booking for this guest and room");
+        bool legacy = !existing->isDated();
+        store.cancelBooking(fields[1], roomNum);
+        if (legacy) store.setRoomAvailable(roomNum, true); // Legacy bookings hold the whole room
+        return "";
+    }
 
-        // Show available rooms with prices
-        printRoomPrices(rooms);
+    if (command == "confirm") {
+        expectFields(3);
+        int roomNum = batchRoomNumber(fields[2]);
+        const Booking* b = store.findBooking(fields[1], roomNum);
+        if (!b) throw runtime_error("no booking for this guest and room");
+        if (!b->referenceID.empty()) throw runtime_error("already confirmed as " + b->referenceID.str());
+        string referenceID = generateReferenceID();
+        store.confirmBooking(fields[1], roomNum, referenceID);
+        return referenceID;
+    }
 
-        // Check if any rooms are available
-        bool anyAvailable = any_of(rooms.begin(), rooms.end(), [](const Room& r) {
-            return r.isAvailable;
-        });
+    if (command == "group") {
+        expectFields(5);
+        GroupRequest request;
+        request.guest = fields[1];
+        if (!parseDate(fields[2], request.checkIn)) throw runtime_error("check-in must be YYYY-MM-DD and not in the past");
+        if (!parseNumber(fields[3], request.nights)) throw runtime_error("nights must be 1 to 30");
+        parseGroupRooms(fields[4], request);
+        vector<Booking> members = bookGroup(store, request);
+        string rooms;
+        for (const Booking& b : members) rooms += (rooms.empty() ? "" : " ") + to_string(b.roomNumber);
+        return members.front().referenceID.str() + "," + formatCents(groupTotal(members).cents()) + "," + rooms;
+    }
 
-        if (!anyAvailable) {
-            cout << "Sorry, no rooms are available at the moment.\n";
-            return;
+    if (command == "find" || command == "cancel-ref") {
+        expectFields(2);
+        string referenceID = fields[1];
+        if (!normalizeReferenceID(referenceID)) throw runtime_error("invalid reference ID");
+        if (isGroupReferenceID(referenceID)) {
+            if (command == "find") throw runtime_error("a group reference ID covers several bookings; list them with list,<guest>");
+            if (store.cancelGroup(referenceID) == 0) throw runtime_error("no booking with this reference ID");
+            return "";
         }
+        const Booking* b = store.findBookingByReference(referenceID);
+        if (!b) throw runtime_error("no booking with this reference ID");
+        if (command == "find") return b->serialize();
+        bool legacy = !b->isDated();
+        int roomNum = b->roomNumber;
+        store.cancelBookingByReference(referenceID);
+        if (legacy) store.setRoomAvailable(roomNum, true);
+        return "";
+    }
 
-        // Select room
-        string roomInput;
-        int roomNum;
-        while (true) {
-            cout << "Enter room number to book (0 to return to menu): ";
-            cin >> roomInput;
-            stringstream ss(roomInput);
-            if ((ss >> roomNum) && ss.eof()) break;
-            cout << "Invalid input. Please enter a valid room number: ";
-        }
+    if (command == "add-room") {
+        expectFields(3);
+        int roomNum = batchRoomNumber(fields[1]);
+        string type = fields[2];
+        if (!normalizeRoomType(type)) throw runtime_error("room type must be Single, Double or Suite");
+        double price = roomListPrice(type);
+        if (!store.addRoom({roomNum, type, price, true})) throw runtime_error("room number already exists");
+        return formatMoney(price);
+    }
 
-        if (roomNum == 0) {
-            cout << "Returning to menu...\n";
-            return;
-        }
+    if (command == "delete-room") {
+        expectFields(2);
+        int roomNum = batchRoomNumber(fields[1]);
+        if (!store.findRoom(roomNum)) throw runtime_error("room does not exist");
+        if (store.hasBookingForRoom(roomNum)) throw runtime_error("room has an active booking");
+        store.removeRoom(roomNum);
+        return "";
+    }
+
+    if (command == "update-type") {
+        expectFields(3);
+        int roomNum = batchRoomNumber(fields[1]);
+        string type = fields[2];
+        if (!normalizeRoomType(type)) throw runtime_error("room type must be Single, Double or Suite");
+        double price = roomListPrice(type);
+        if (!store.updateRoom(roomNum, type, price)) throw runtime_error("room does not exist");
+        return formatMoney(price);
+    }
 
-        // Check if room exists and is available
-        auto it = find_if(rooms.begin(), rooms.end(),
-            [roomNum](const Room& r) { return r.roomNumber == roomNum; });
+    throw runtime_error("unknown command");
+}
 
-        if (it == rooms.end() || !it->isAvailable) {
-            cout << "Room is not available or does not exist.\n";
-            return;
-        }
+// Runs every command in path ("-" for standard input) against the loaded
+// store as a single batch, so the changes are saved once at the end.
+// Prints one result line per command once they are saved:
+//   <line>,ok,<command>[,<detail>]      detail: cost, reference ID, room price or booking;
+//                                       for a group <group reference ID>,<total>,<rooms>
+//   <line>,error,<command>,<reason>
+// Returns the number of commands that failed.
+size_t runBatch(HotelStore& store, const string& path) {
+    string text;
+    if (path == "-") {
+        text.assign(istreambuf_iterator<char>(cin), istreambuf_iterator<char>());
+    } else {
+        MappedFile file(path);
+        text = string(file.view());
+    }
 
-        // Prevent double booking by the same guest
-        for (const auto& b : bookings) {
-            if (b.guestName == username && b.roomNumber == roomNum) {
-                cout << "You already have a booking for this room.\n";
-                return;
+    vector<pair<size_t, vector<string>>> commands; // Line number, fields
+    forEachLine(text, [&](string_view line, size_t lineNo) {
+        size_t first = line.find_first_not_of(" \t");
+        if (first == string_view::npos || line[first] == '#') return;
+        commands.push_back({lineNo, splitCommand(line)});
+    });
+
+    size_t failed = 0;
+    string results;
+    store.withBatch([&]() {
+        for (const auto& [lineNo, fields] : commands) {
+            results += to_string(lineNo) + ",";
+            try {
+                string detail = runBatchCommand(store, fields);
+                results += "ok," + fields[0];
+                if (!detail.empty()) results += "," + detail;
+            } catch (const exception& e) {
+                results += "error," + fields[0] + "," + e.what();
+                ++failed;
             }
+            results += "\n";
         }
+    });
 
-        // Get number of nights
-        string nightsInput;
-        int nights;
-        while (true) {
-            cout << "Enter number of nights: ";
-            cin >> nightsInput;
-            stringstream ss(nightsInput);
-            if ((ss >> nights) && ss.eof() && nights > 0 && nights <= 30) break;
-            cout << "Invalid. Enter a positive number (1–30): ";
-        }
+    cout << results;
+    cerr << commands.size() << " commands, " << failed << " failed\n";
+    return failed;
+}
 
-        // Calculate cost and book
-        double cost = calculatePrice(it->roomType, nights);
-        Booking booking{username, roomNum, nights, cost, ""}; // Reference assigned on confirmation
-        bookings.push_back(booking);
-        saveBookings(bookings);
+// ----------------- Data Generator -----------------
 
-        it->isAvailable = false;
-        saveRooms(rooms);
+// Weights 1, 1/2, 1/3, ... so that a few entries are picked far more often
+// than the rest, as with the names of real guests
+discrete_distribution<size_t> zipfDistribution(size_t count) {
+    vector<double> weights(count);
+    for (size_t i = 0; i < count; ++i) weights[i] = 1.0 / static_cast<double>(i + 1);
+    return discrete_distribution<size_t>(weights.begin(), weights.end());
+}
 
-        cout << "Booking successful!\nTotal cost for Room " << roomNum << ": $"
-             << fixed << setprecision(2) << cost << " for " << nights << " night(s).\n";
+// Writes rooms.txt, bookings.txt and ref_counter.txt for a synthetic hotel
+// into the current directory, or rooms.txt and bookings.txt into a
+// property's directory, whose reference IDs are then reserved from the
+// shared ref_counter.txt so they clash with no other property's. Room types follow a 60/30/10 Single/Double/
+// Suite mix and rooms are numbered by floor (100-199, 200-299, ...). Guest
+// names combine first and last names drawn with a Zipf skew, so a few
+// guests book often and most book once or twice; like the menus, no guest
+// holds two bookings for one room. Stays are 1-30 nights, mostly short,
+// never overlap within a room, and about 60% are confirmed.
+// The same seed always produces the same files. Bookings are streamed to
+// disk, so 10M of them do not have to fit in memory.
+void generateHotelData(size_t roomCount, size_t bookingCount, unsigned seed, const string& directory = "") {
+    static const char* const firstNames[] = {
+        "James", "Mary", "Robert", "Patricia", "John", "Jennifer", "Michael", "Linda", "David", "Elizabeth",
+        "William", "Barbara", "Richard", "Susan", "Joseph", "Jessica", "Thomas", "Sarah", "Maria", "Karen",
+        "Wei", "Yuki", "Ahmed", "Fatima", "Carlos", "Ana", "Ivan", "Olga", "Raj", "Priya",
+        "Kwame", "Amara", "Lucas", "Sofia", "Mateo", "Chloe", "Noah", "Emma", "Liam", "Aiko"};
+    static const char* const lastNames[] = {
+        "Smith", "Johnson", "Garcia", "Brown", "Jones", "Miller", "Davis", "Rodriguez", "Martinez", "Lopez",
+        "Wilson", "Anderson", "Taylor", "Thomas", "Moore", "Jackson", "Martin", "Lee", "Nguyen", "Kim",
+        "Chen", "Wang", "Singh", "Patel", "Khan", "Santos", "Reyes", "Cruz", "Tanaka", "Sato",
+        "Ivanov", "Muller", "Rossi", "Dubois", "Silva", "Cohen", "Okafor", "Mensah", "Dela Cruz", "Bautista"};
+    const size_t firstCount = sizeof firstNames / sizeof firstNames[0];
+    const size_t lastCount = sizeof lastNames / sizeof lastNames[0];
+
+    mt19937_64 rng(seed);
+    discrete_distribution<int> pickType({60, 30, 10});
+    const char* const types[] = {"Single", "Double", "Suite"};
+
+    vector<int> roomNumbers(roomCount);
+    vector<const char*> roomTypes(roomCount);
+    {
+        ofstream out(dataFile(directory, "rooms.txt"));
+        if (!out) throw runtime_error("Unable to open rooms.txt for writing");
+        for (size_t i = 0; i < roomCount; ++i) {
+            roomNumbers[i] = static_cast<int>((i / 100 + 1) * 100 + i % 100);
+            roomTypes[i] = types[pickType(rng)];
+            out << Room{roomNumbers[i], roomTypes[i], roomListPrice(roomTypes[i]), true}.serialize() << "\n";
+        }
+        if (!out) throw runtime_error("Failed writing rooms.txt");
     }
 
-    // Cancels a booking for the current guest
-    void cancelBooking() {
-        auto bookings = loadBookings();
-        auto rooms = loadRooms();
+    auto pickFirst = zipfDistribution(firstCount), pickLast = zipfDistribution(lastCount);
+    uniform_int_distribution<size_t> pickRoom(0, roomCount - 1);
+    geometric_distribution<int> extraNights(0.35), gapDays(0.4);
+    bernoulli_distribution confirmed(0.6);
 
-        // Filter bookings for the current guest
-        vector<Booking> myBookings;
-        for (const auto& b : bookings) {
-            if (b.guestName == username) {
-                myBookings.push_back(b);
+    // Each room is booked forward in time from its own starting day, and
+    // keeps the sorted ids (first * lastCount + last) of its guests
+    vector<int> nextFree(roomCount);
+    vector<vector<uint16_t>> roomGuests(roomCount);
+    uniform_int_distribution<int> firstDay(0, 30);
+    for (auto& day : nextFree) day = today() + firstDay(rng);
+
+    long long lastReference = directory.empty() ? 1000 : ReferenceIdAllocator().reserve(max<size_t>(1, bookingCount)) - 1;
+    {
+        ofstream out(dataFile(directory, "bookings.txt"));
+        if (!out) throw runtime_error("Unable to open bookings.txt for writing");
+        for (size_t i = 0; i < bookingCount && roomCount > 0; ++i) {
+            size_t room = pickRoom(rng);
+            Booking b;
+            auto& guests = roomGuests[room];
+            for (int attempt = 0; attempt < 64 && b.guestName.empty(); ++attempt) {
+                size_t first = pickFirst(rng), last = pickLast(rng);
+                auto id = static_cast<uint16_t>(first * lastCount + last);
+                auto at = lower_bound(guests.begin(), guests.end(), id);
+                if (at != guests.end() && *at == id) continue; // Already staying in this room
+                guests.insert(at, id);
+                b.guestName = string(firstNames[first]) + " " + lastNames[last];
             }
+            if (b.guestName.empty()) b.guestName = "Guest " + to_string(i); // Popular names all taken here
+            b.roomNumber = roomNumbers[room];
+            b.nights = min(30, 1 + extraNights(rng));
+            b.referenceID = confirmed(rng) ? "REF" + to_string(++lastReference) : "";
+            b.checkIn = nextFree[room] + gapDays(rng);
+            b.totalCost = pricing().quote(roomTypes[room], b.checkIn, b.nights);
+            nextFree[room] = b.checkOut();
+            out << b.serialize() << "\n";
         }
+        if (!out) throw runtime_error("Failed writing bookings.txt");
+    }
 
-        if (myBookings.empty()) {
-            cout << "You have no bookings to cancel.\n";
-            return;
-        }
+    // New confirmations must not reuse the generated reference IDs
+    if (!directory.empty()) return; // Already reserved above
+    ofstream counter("ref_counter.txt");
+    counter << lastReference;
+}
 
-        // Display guest's bookings
-        cout << "\nYour Current Bookings:\n";
-        for (const auto& b : myBookings) {
-            cout << "Guest: " << b.guestName
-                 << ", Room " << b.roomNumber
-                 << ", Nights: " << b.nights
-                 << ", Total: $" << fixed << setprecision(2) << b.totalCost
-                 << ", Status: " << (b.referenceID.empty() ? "Unpaid" : "Paid") << "\n";
+// ----------------- Benchmarks -----------------
+
+// Milliseconds taken by the fastest of several runs of fn
+template <typename Fn>
+double bestOfRuns(int runs, Fn fn) {
+    double best = numeric_limits<double>::max();
+    for (int i = 0; i < runs; ++i) {
+        auto start = chrono::steady_clock::now();
+        fn();
+        chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+        best = min(best, elapsed.count());
+    }
+    return best;
+}
+
+// Compares the stringstream-based deserializers with the mapped
+// from_chars parser on synthetic rooms and bookings files
+void runParseBenchmark(size_t records) {
+    const string roomsPath = "bench_rooms.tmp";
+    const string bookingsPath = "bench_bookings.tmp";
+    {
+        ofstream roomsOut(roomsPath), bookingsOut(bookingsPath);
+        const char* types[] = {"Single", "Double", "Suite"};
+        for (size_t i = 0; i < records; ++i) {
+            Room r{static_cast<int>(100 + i), types[i % 3], 100.0 + (i % 3) * 80.0, i % 2 == 0};
+            Booking b{"guest" + to_string(i % 5000), static_cast<int>(100 + i), static_cast<int>(1 + i % 14),
+                      100.0 * (1 + i % 14), i % 3 == 0 ? "REF" + to_string(1001 + i) : ""};
+            roomsOut << r.serialize() << "\n";
+            bookingsOut << b.serialize() << "\n";
         }
+    }
 
-        // Get room number to cancel
-        int roomNum;
-        cout << "Enter the room number to cancel (0 to return to menu): ";
-        while (!(cin >> roomNum)) {
-            cin.clear(); cin.ignore(numeric_limits<streamsize>::max(), '\n');
-            cout << "Invalid input. Enter a valid room number (0 to cancel): ";
+    auto legacyRooms = [&]() {
+        vector<Room> rooms;
+        ifstream file(roomsPath);
+        string line;
+        while (getline(file, line))
+            if (!line.empty()) rooms.push_back(Room::deserialize(line));
+        return rooms;
+    };
+    auto legacyBookings = [&]() {
+        vector<Booking> bookings;
+        ifstream file(bookingsPath);
+        string line;
+        while (getline(file, line))
+            if (!line.empty()) bookings.push_back(Booking::deserialize(line));
+        return bookings;
+    };
+
+    const int runs = 5;
+    size_t sink = 0; // Keeps the optimizer from dropping the parse results
+    double roomsOld = bestOfRuns(runs, [&]() { sink += legacyRooms().size(); });
+    double roomsNew = bestOfRuns(runs, [&]() { sink += loadRooms(roomsPath).size(); });
+    double bookingsOld = bestOfRuns(runs, [&]() { sink += legacyBookings().size(); });
+    double bookingsNew = bestOfRuns(runs, [&]() { sink += loadBookings(bookingsPath).size(); });
+
+    remove(roomsPath.c_str());
+    remove(bookingsPath.c_str());
+
+    auto report = [records](const char* name, double oldMs, double newMs) {
+        cout << left << setw(10) << name
+             << right << fixed << setprecision(2)
+             << setw(14) << oldMs << setw(14) << newMs
+             << setw(10) << oldMs / newMs << "x"
+             << setw(16) << setprecision(0) << records / (newMs / 1000.0) << "\n";
+    };
+    cout << "Parse benchmark: " << records << " records per file, best of " << runs << " runs\n";
+    cout << left << setw(10) << "File" << right << setw(14) << "stream (ms)" << setw(14) << "mapped (ms)"
+         << setw(11) << "speedup" << setw(16) << "records/s" << "\n";
+    report("rooms", roomsOld, roomsNew);
+    report("bookings", bookingsOld, bookingsNew);
+    if (sink == 0) cout << "(no records parsed)\n";
+}
+
+// Rooms and bookings as they were held before records were made compact:
+// every string owned by the record and money as a double
+struct PlainRoom {
+    int roomNumber;
+    string roomType;
+    double price;
+    bool isAvailable;
+};
+
+struct PlainBooking {
+    string guestName;
+    int roomNumber;
+    int nights;
+    double totalCost;
+    string referenceID;
+    int checkIn;
+};
+
+// Heap bytes a string holds outside its own object; none if it is short
+// enough to be stored inline
+size_t stringHeapBytes(const string& s) {
+    const char* self = reinterpret_cast<const char*>(&s);
+    return s.data() >= self && s.data() < self + sizeof s ? 0 : s.capacity() + 1;
+}
+
+// Loads the hotel in directory (empty for the current one) and reports the bytes each room
+// and booking takes as plain records and as compact ones. Compact records
+// are charged their share of the intern pools, which loading fills.
+void runMemoryBenchmark(const string& directory) {
+    size_t poolsBefore[] = {roomTypeNames().bytes(), guestNames().bytes() + referenceTexts().bytes()};
+    HotelStore store(directory);
+    store.load();
+    size_t roomCount = store.allRooms().size(), bookingCount = store.bookingCount();
+    if (roomCount == 0 || bookingCount == 0) throw runtime_error("No rooms or bookings here; try --generate-data first");
+    double roomPool = static_cast<double>(roomTypeNames().bytes() - poolsBefore[0]) / roomCount;
+    double bookingPool = static_cast<double>(guestNames().bytes() + referenceTexts().bytes() - poolsBefore[1]) / bookingCount;
+
+    vector<PlainRoom> plainRooms;
+    plainRooms.reserve(roomCount);
+    for (const auto& r : store.allRooms()) plainRooms.push_back({r.roomNumber, r.roomType.str(), r.price, r.isAvailable});
+    vector<PlainBooking> plainBookings;
+    plainBookings.reserve(bookingCount);
+    store.forEachBooking([&](const Booking& b) {
+        plainBookings.push_back({b.guestName.str(), b.roomNumber, b.nights, b.totalCost, b.referenceID.str(), b.checkIn});
+    });
+
+    size_t roomHeap = 0, bookingHeap = 0;
+    for (const auto& r : plainRooms) roomHeap += stringHeapBytes(r.roomType);
+    for (const auto& b : plainBookings) bookingHeap += stringHeapBytes(b.guestName) + stringHeapBytes(b.referenceID);
+    double plainRoom = sizeof(PlainRoom) + static_cast<double>(roomHeap) / roomCount;
+    double plainBooking = sizeof(PlainBooking) + static_cast<double>(bookingHeap) / bookingCount;
+    double compactRoom = sizeof(Room) + roomPool, compactBooking = sizeof(Booking) + bookingPool;
+
+    auto report = [](const char* name, double plain, double compact) {
+        cout << left << setw(10) << name << right << fixed << setprecision(1)
+             << setw(12) << plain << setw(12) << compact
+             << setw(9) << setprecision(0) << 100.0 * (plain - compact) / plain << "%\n";
+    };
+    cout << "Record memory: " << roomCount << " rooms, " << bookingCount << " bookings (bytes per record)\n";
+    cout << left << setw(10) << "Record" << right << setw(12) << "plain" << setw(12) << "compact" << setw(10) << "saved" << "\n";
+    report("rooms", plainRoom, compactRoom);
+    report("bookings", plainBooking, compactBooking);
+}
+
+// Times repeated samples of one operation and reports throughput and
+// p50/p99 latency. A sample may cover several operations (batched when a
+// single one is too quick to time); its latency is then the per-operation
+// average within the sample.
+class LatencyRecorder {
+public:
+    explicit LatencyRecorder(const string& operation) : name(operation) {}
+
+    // Runs fn once and records it as a sample of operations operations
+    template <typename Fn>
+    void sample(Fn fn, size_t operations = 1) {
+        auto start = chrono::steady_clock::now();
+        fn();
+        chrono::duration<double, micro> elapsed = chrono::steady_clock::now() - start;
+        totalMicros += elapsed.count();
+        totalOperations += operations;
+        perOperation.push_back(elapsed.count() / static_cast<double>(operations));
+    }
+
+    // Adds the samples of another recorder of the same operation
+    void merge(const LatencyRecorder& other) {
+        perOperation.insert(perOperation.end(), other.perOperation.begin(), other.perOperation.end());
+        totalMicros += other.totalMicros;
+        totalOperations += other.totalOperations;
+    }
+
+    size_t operations() const { return totalOperations; }
+
+    // Nearest-rank latency percentile in microseconds per operation (0 if no samples)
+    double latency(double q) {
+        if (perOperation.empty()) return 0;
+        sort(perOperation.begin(), perOperation.end());
+        return percentile(q);
+    }
+
+    void report() {
+        if (perOperation.empty()) return;
+        sort(perOperation.begin(), perOperation.end());
+        cout << left << setw(24) << name << right
+             << setw(12) << totalOperations
+             << setw(16) << fixed << setprecision(0) << totalOperations / (totalMicros / 1e6)
+             << setw(14) << formatDuration(percentile(0.50))
+             << setw(14) << formatDuration(percentile(0.99)) << "\n";
+    }
+
+    static void printHeader() {
+        cout << left << setw(24) << "Operation" << right << setw(12) << "ops" << setw(16) << "ops/s"
+             << setw(14) << "p50" << setw(14) << "p99" << "\n";
+    }
+
+private:
+    string name;
+    vector<double> perOperation; // Microseconds per operation of each sample
+    double totalMicros = 0;
+    size_t totalOperations = 0;
+
+    // Nearest-rank percentile of the sorted samples
+    double percentile(double q) const {
+        size_t rank = static_cast<size_t>(ceil(q * static_cast<double>(perOperation.size())));
+        return perOperation[min(perOperation.size(), max<size_t>(rank, 1)) - 1];
+    }
+};
+
+// Times the book, confirm and cancel flows the menus run, through a
+// HotelStore in the given storage mode: flowCount of each, on distinct
+// rooms, with stays far enough ahead never to collide with generated ones
+void benchmarkFlows(StorageMode mode, size_t flowCount) {
+    HotelStore store;
+    store.setStorageMode(mode);
+    store.load();
+
+    vector<int> roomNumbers;
+    for (const auto& r : store.allRooms()) {
+        if (roomNumbers.size() == flowCount) break;
+        roomNumbers.push_back(r.roomNumber);
+    }
+    const string guest = "Bench Guest";
+    const int checkIn = today() + 20000;
+    const int nights = 3;
+    string label = mode == StorageMode::Journal ? " (journal)" : " (rewrite)";
+
+    LatencyRecorder book("book" + label), confirm("confirm" + label), cancel("cancel" + label);
+    for (int roomNum : roomNumbers) {
+        book.sample([&]() {
+            store.withRoom(roomNum, [&]() {
+                const Room* room = store.findRoom(roomNum);
+                if (!room || !store.isRoomFree(roomNum, checkIn, checkIn + nights) || store.findBooking(guest, roomNum)) return;
+                store.addBooking({guest, roomNum, nights, pricing().quote(*room, checkIn, nights), "", checkIn});
+            });
+        });
+    }
+    for (int roomNum : roomNumbers) {
+        confirm.sample([&]() {
+            store.withRoom(roomNum, [&]() {
+                const Booking* b = store.findBooking(guest, roomNum);
+                if (b && b->referenceID.empty()) store.confirmBooking(guest, roomNum, generateReferenceID());
+            });
+        });
+    }
+    for (int roomNum : roomNumbers) {
+        cancel.sample([&]() {
+            store.withRoom(roomNum, [&]() { store.cancelBooking(guest, roomNum); });
+        });
+    }
+    store.waitForCompaction();
+
+    book.report();
+    confirm.report();
+    cancel.report();
+}
+
+// Generates a hotel of the given size in a scratch directory and reports
+// throughput and p50/p99 latency of loading and saving the data files, of
+// calculatePrice, and of the book/confirm/cancel flows in both storage
+// modes. runs is the number of timed loads and saves; flowCount the
+// number of each flow per mode.
+void runBenchmarkSuite(size_t roomCount, size_t bookingCount, int runs, size_t flowCount) {
+    char dirTemplate[] = "/tmp/hotel-bench-XXXXXX";
+    if (!mkdtemp(dirTemplate)) throw runtime_error("Unable to create scratch directory");
+    string dir = dirTemplate;
+    string previousDir = filesystem::current_path().string();
+    filesystem::current_path(dir);
+
+    try {
+        auto start = chrono::steady_clock::now();
+        generateHotelData(roomCount, bookingCount, 42);
+        chrono::duration<double, micro> generated = chrono::steady_clock::now() - start;
+        cout << "Benchmark: " << roomCount << " rooms, " << bookingCount << " bookings (generated in "
+             << formatDuration(generated.count()) << "), " << runs << " runs, " << flowCount << " flows per mode\n";
+        LatencyRecorder::printHeader();
+
+        size_t sink = 0; // Keeps the optimizer from dropping results
+        LatencyRecorder loadRoomsTime("loadRooms (per room)");
+        for (int i = 0; i < runs; ++i) loadRoomsTime.sample([&]() { sink += loadRooms().size(); }, max<size_t>(roomCount, 1));
+        loadRoomsTime.report();
+
+        vector<Booking> bookings;
+        LatencyRecorder loadBookingsTime("loadBookings (per bkg)");
+        for (int i = 0; i < runs; ++i) loadBookingsTime.sample([&]() { bookings = loadBookings(); }, max<size_t>(bookingCount, 1));
+        loadBookingsTime.report();
+
+        LatencyRecorder saveBookingsTime("saveBookings (per bkg)");
+        for (int i = 0; i < runs; ++i) saveBookingsTime.sample([&]() { saveBookings(bookings); }, max<size_t>(bookingCount, 1));
+        saveBookingsTime.report();
+        bookings = vector<Booking>(); // Give the memory back before the flows load their own copy
+
+        const char* types[] = {"Single", "Double", "Suite"};
+        const size_t pricesPerSample = 1000;
+        double total = 0;
+        LatencyRecorder priceTime("calculatePrice");
+        for (int i = 0; i < 1000; ++i) {
+            priceTime.sample([&]() {
+                for (size_t j = 0; j < pricesPerSample; ++j) total += calculatePrice(types[j % 3], 1 + static_cast<int>(j % 14));
+            }, pricesPerSample);
         }
+        priceTime.report();
 
-        if (roomNum == 0) {
-            cout << "Returning to menu...\n";
-            return;
+        // A search results page: every room type on a range of dated stays
+        vector<QuoteRequest> requests;
+        for (size_t j = 0; j < 10000; ++j)
+            requests.push_back({pricing().baseRate(types[j % 3]), today() + static_cast<int>(j % 365), 1 + static_cast<int>(j % 14)});
+        vector<double> totals;
+        LatencyRecorder quoteTime("quoteAll (per quote)");
+        for (int i = 0; i < 200; ++i) {
+            quoteTime.sample([&]() {
+                pricing().quoteAll(requests, totals);
+                total += totals.back();
+            }, requests.size());
         }
+        quoteTime.report();
+        if (total < 0) ++sink;
 
-        // Find and remove the booking
-        bool found = false;
-        for (auto it = bookings.begin(); it != bookings.end(); ++it) {
-            if (it->guestName == username && it->roomNumber == roomNum) {
-                bookings.erase(it);
-                found = true;
-                break;
+        {
+            HotelStore store;
+            store.load();
+
+            // The guest's "what is free" query over the next month
+            LatencyRecorder freeTime("freeRooms (3 nights)");
+            size_t freeFound = 0;
+            for (int day = 0; day < 30; ++day)
+                freeTime.sample([&]() { freeFound += store.freeRooms(today() + day, today() + day + 3).size(); });
+            freeTime.report();
+            sink += freeFound;
+
+            // The cheapest free room of a type, as "assign me a room" asks
+            LatencyRecorder bestTime("searchRooms best fit");
+            for (int day = 0; day < 30; ++day) {
+                RoomQuery query;
+                query.roomType = "Suite";
+                query.checkIn = today() + day;
+                query.checkOut = query.checkIn + 3;
+                query.limit = 1;
+                bestTime.sample([&]() { sink += store.searchRooms(query).size(); });
             }
-        }
+            bestTime.report();
 
-        if (!found) {
-            cout << "No booking found under your name for room " << roomNum << ".\n";
-            return;
+            // The admin report, on one thread and on every core
+            size_t cores = max(1u, thread::hardware_concurrency());
+            for (size_t threads : {size_t(1), cores}) {
+                LatencyRecorder reportTime("report, " + to_string(threads) + " thr (per bkg)");
+                for (int i = 0; i < runs; ++i)
+                    reportTime.sample([&]() { sink += buildRevenueReport(store.view(), today(), threads).size(); },
+                                      max<size_t>(bookingCount, 1));
+                reportTime.report();
+                if (cores == 1) break;
+            }
         }
 
-        // Mark room as available
-        for (auto& r : rooms) {
-            if (r.roomNumber == roomNum) {
-                r.isAvailable = true;
-                break;
+        benchmarkFlows(StorageMode::Rewrite, flowCount);
+        benchmarkFlows(StorageMode::Journal, flowCount);
+        if (sink == 0) cout << "(no records loaded)\n";
+    } catch (...) {
+        filesystem::current_path(previousDir);
+        filesystem::remove_all(dir);
+        throw;
+    }
+    filesystem::current_path(previousDir);
+    filesystem::remove_all(dir);
+}
+
+// Measures what each durability level costs: threads writers each book
+// and cancel stays on rooms of their own, commits times in all, through
+// one HotelStore per storage mode and level. The scratch directory is made
+// in the current one, since /tmp is often memory-backed and syncs nothing.
+void runDurabilityBenchmark(size_t threads, size_t commits) {
+    char dirTemplate[] = "hotel-durability-XXXXXX";
+    if (!mkdtemp(dirTemplate)) throw runtime_error("Unable to create scratch directory");
+    string dir = filesystem::absolute(dirTemplate).string();
+    string previousDir = filesystem::current_path().string();
+    filesystem::current_path(dir);
+
+    try {
+        const int roomsPerThread = 4;
+        cout << "Durability benchmark: " << threads << " threads x " << commits << " commits\n";
+        cout << left << setw(10) << "Storage" << setw(12) << "Durability" << right << setw(12) << "commits/s"
+             << setw(14) << "p50" << setw(14) << "p99" << setw(12) << "syncs" << "\n";
+
+        for (StorageMode mode : {StorageMode::Rewrite, StorageMode::Journal}) {
+            for (Durability level : {Durability::None, Durability::Strict, Durability::Group}) {
+                if (mode == StorageMode::Rewrite && level == Durability::Group) continue; // Same as strict there
+                for (const char* file : {"rooms.txt", "bookings.txt", JOURNAL_FILE, JOURNAL_COMPACTING_FILE}) remove(file);
+                vector<Room> rooms;
+                for (size_t i = 0; i < threads * roomsPerThread; ++i) rooms.push_back({static_cast<int>(100 + i), "Single", 100.0, true});
+                saveRooms(rooms);
+                saveBookings({});
+
+                HotelStore store;
+                store.setStorageMode(mode, 0); // Compaction would only add noise
+                store.setDurability(level);
+                store.load();
+
+                vector<LatencyRecorder> recorders(threads, LatencyRecorder("commit"));
+                vector<thread> writers;
+                auto start = chrono::steady_clock::now();
+                for (size_t t = 0; t < threads; ++t) {
+                    writers.emplace_back([&, t]() {
+                        const int firstDay = today() + 1;
+                        for (size_t i = 0; i < commits / 2; ++i) {
+                            int roomNum = static_cast<int>(100 + t * roomsPerThread + i % roomsPerThread);
+                            string guest = "d" + to_string(t) + "-" + to_string(i);
+                            int checkIn = firstDay + static_cast<int>(i % 300);
+                            recorders[t].sample([&]() {
+                                store.withRoom(roomNum, [&]() { store.addBooking({guest, roomNum, 1, 100.0, "", checkIn}); });
+                            });
+                            recorders[t].sample([&]() {
+                                store.withRoom(roomNum, [&]() { store.cancelBooking(guest, roomNum); });
+                            });
+                        }
+                    });
+                }
+                for (auto& writer : writers) writer.join();
+                chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+                LatencyRecorder all("commit");
+                for (const auto& recorder : recorders) all.merge(recorder);
+                cout << left << setw(10) << (mode == StorageMode::Journal ? "journal" : "rewrite") << setw(12) << durabilityName(level)
+                     << right << setw(12) << fixed << setprecision(0) << all.operations() / elapsed.count()
+                     << setw(14) << formatDuration(all.latency(0.50)) << setw(14) << formatDuration(all.latency(0.99))
+                     << setw(12);
+                if (mode == StorageMode::Journal && level != Durability::None) cout << store.journalSyncs() << "\n";
+                else cout << "-" << "\n";
             }
         }
+    } catch (...) {
+        filesystem::current_path(previousDir);
+        filesystem::remove_all(dir);
+        throw;
+    }
+    filesystem::current_path(previousDir);
+    filesystem::remove_all(dir);
+}
 
-        saveBookings(bookings);
-        saveRooms(rooms);
+// Measures how the revenue report holds up bookings: one thread books and
+// cancels stays for seconds at a time, first alone, then while another
+// thread keeps running the report holding the store's read lock, as it
+// used to, and then while it keeps running it on views
+void runViewBenchmark(size_t bookingCount, double seconds) {
+    char dirTemplate[] = "/tmp/hotel-views-XXXXXX";
+    if (!mkdtemp(dirTemplate)) throw runtime_error("Unable to create scratch directory");
+    string dir = dirTemplate;
+    string previousDir = filesystem::current_path().string();
+    filesystem::current_path(dir);
 
-        cout << "Booking for room " << roomNum << " has been canceled.\n";
-    }
+    try {
+        generateHotelData(1000, bookingCount, 42);
+        HotelStore store;
+        store.setStorageMode(StorageMode::Journal, 0); // Compaction would only add noise
+        store.load();
+        vector<int> roomNumbers;
+        for (const auto& r : store.allRooms()) roomNumbers.push_back(r.roomNumber);
+        const size_t cores = max(1u, thread::hardware_concurrency());
+        const int night = today();
 
-    // Displays and allows confirmation of guest's bookings
-    void viewMyBookings() {
-        auto bookings = loadBookings();
-        bool found = false;
+        cout << "View benchmark: " << bookingCount << " bookings, " << seconds << " s per run\n";
+        cout << left << setw(22) << "Reports" << right << setw(12) << "commits/s" << setw(14) << "p50" << setw(14) << "p99"
+             << setw(14) << "max" << setw(10) << "reports" << "\n";
+        for (int readers = 0; readers < 3; ++readers) {
+            atomic<bool> stop{false};
+            size_t reports = 0;
+            thread reader;
+            if (readers > 0) {
+                reader = thread([&]() {
+                    while (!stop) {
+                        HotelStore::View view = store.view();
+                        if (readers == 1) store.read([&]() { return buildRevenueReport(view, night, cores).size(); });
+                        else buildRevenueReport(view, night, cores);
+                        ++reports;
+                    }
+                });
+            }
 
-        cout << "\n--- Your Bookings ---\n";
-        for (const auto& b : bookings) {
-            if (b.guestName == username) {
-                cout << "Room " << b.roomNumber
-                     << ", Nights: " << b.nights
-                     << ", Cost: $" << fixed << setprecision(2) << b.totalCost
-                     << ", Status: " << (b.referenceID.empty() ? "Unpaid" : "Paid");
-                if (!b.referenceID.empty())
-                    cout << ", Reference ID: " << b.referenceID;
-                cout << "\n";
-                found = true;
+            LatencyRecorder commits("commit");
+            auto start = chrono::steady_clock::now();
+            chrono::duration<double> elapsed{0};
+            for (size_t i = 0; elapsed.count() < seconds; ++i) {
+                int roomNum = roomNumbers[i % roomNumbers.size()];
+                string guest = "View Bench " + to_string(i);
+                int checkIn = today() + 20000; // Far past any generated stay
+                commits.sample([&]() {
+                    store.withRoom(roomNum, [&]() { store.addBooking({guest, roomNum, 1, 100.0, "", checkIn}); });
+                });
+                commits.sample([&]() {
+                    store.withRoom(roomNum, [&]() { store.cancelBooking(guest, roomNum); });
+                });
+                elapsed = chrono::steady_clock::now() - start;
             }
-        }
+            stop = true;
+            if (reader.joinable()) reader.join();
 
-        if (!found) {
-            cout << "You have no bookings.\n";
-            return;
+            const char* names[] = {"none", "under the read lock", "on views"};
+            cout << left << setw(22) << names[readers] << right << setw(12) << fixed << setprecision(0)
+                 << commits.operations() / elapsed.count() << setw(14) << formatDuration(commits.latency(0.50))
+                 << setw(14) << formatDuration(commits.latency(0.99)) << setw(14) << formatDuration(commits.latency(1.0))
+                 << setw(10) << reports << "\n";
         }
+    } catch (...) {
+        filesystem::current_path(previousDir);
+        filesystem::remove_all(dir);
+        throw;
+    }
+    filesystem::current_path(previousDir);
+    filesystem::remove_all(dir);
+}
 
-        // Ask if user wants to confirm a booking
-        string confirmInput;
-        char confirmChar;
-        while (true) {
-            cout << "\nWould you like to confirm a booking and receive a reference ID? (y/n): ";
-            cin >> confirmInput;
-            if (confirmInput.length() == 1) {
-                confirmChar = tolower(confirmInput[0]);
-                if (confirmChar == 'y' || confirmChar == 'n') break;
+// ----------------- Stress Test -----------------
+
+// One worker of the stress test: books, cancels and confirms random stays
+// through its own HotelStore, then writes the bookings it expects to
+// survive to expected-<worker>.txt
+void runStressWorker(int worker, int operations, StorageMode mode, int roomCount) {
+    HotelStore store;
+    store.setStorageMode(mode, 50); // Small threshold so compactions race with bookings
+    store.load();
+
+    mt19937 rng(static_cast<unsigned>(worker) * 7919u + 17u);
+    uniform_int_distribution<int> pickRoom(1, roomCount), pickDay(0, 60), pickNights(1, 4), pickAction(0, 9);
+    int firstDay = today() + 1;
+    vector<Booking> mine;
+
+    for (int op = 0; op < operations; ++op) {
+        int action = pickAction(rng);
+        if (action < 7 || mine.empty()) {
+            int roomNum = 100 + pickRoom(rng);
+            Booking b{"w" + to_string(worker) + "-" + to_string(op), roomNum, pickNights(rng), 0.0, "", firstDay + pickDay(rng)};
+            store.withRoom(roomNum, [&]() {
+                const Room* room = store.findRoom(roomNum);
+                if (!room || !store.isRoomFree(roomNum, b.checkIn, b.checkOut())) return;
+                b.totalCost = pricing().quote(*room, b.checkIn, b.nights);
+                store.addBooking(b);
+                mine.push_back(b);
+            });
+        } else {
+            size_t pick = uniform_int_distribution<size_t>(0, mine.size() - 1)(rng);
+            Booking& b = mine[pick];
+            if (action == 7) {
+                store.withRoom(b.roomNumber, [&]() {
+                    if (store.cancelBooking(b.guestName, b.roomNumber)) mine.erase(mine.begin() + pick);
+                });
+            } else if (b.referenceID.empty()) {
+                store.withRoom(b.roomNumber, [&]() {
+                    string referenceID = generateReferenceID();
+                    if (store.confirmBooking(b.guestName, b.roomNumber, referenceID)) b.referenceID = referenceID;
+                });
             }
-            cout << "Invalid input. Please enter 'y' or 'n'.\n";
         }
+    }
+    store.waitForCompaction();
 
-        if (confirmChar != 'y') return;
+    ofstream out("expected-" + to_string(worker) + ".txt");
+    for (const auto& b : mine) out << b.serialize() << "\n";
+}
 
-        // Get room number to confirm
-        string roomInput;
-        int roomNum;
-        while (true) {
-            cout << "Enter the room number to confirm: ";
-            cin >> roomInput;
-            stringstream ss(roomInput);
-            if ((ss >> roomNum) && (ss.eof())) break;
-            cout << "Invalid input. Enter a valid numeric room number: ";
+// Runs several processes against one scratch data directory, in the given
+// data layout, and checks that every booking a worker made is in the final
+// state exactly once, that no room is double-booked, and that no reference
+// ID is issued twice. Returns true on success.
+bool runStressTest(int processes, int operations, StorageMode mode, const ShardLayout& layout = ShardLayout()) {
+    const int roomCount = 20; // Few rooms so that workers contend for them
+    char dirTemplate[] = "/tmp/hotel-stress-XXXXXX";
+    if (!mkdtemp(dirTemplate)) throw runtime_error("Unable to create scratch directory");
+    string dir = dirTemplate;
+    string previousDir = filesystem::current_path().string();
+    filesystem::current_path(dir);
+
+    {
+        vector<Room> rooms;
+        const char* types[] = {"Single", "Double", "Suite"};
+        for (int i = 1; i <= roomCount; ++i) rooms.push_back({100 + i, types[i % 3], 100.0, true});
+        saveRooms(rooms);
+        saveBookings({});
+        if (layout.sharded()) {
+            HotelStore setup;
+            setup.load();
+            setup.migrateLayout(layout);
         }
+    }
 
-        // Update booking with reference ID
-        bool updated = false;
-        for (auto& b : bookings) {
-            if (b.guestName == username && b.roomNumber == roomNum) {
-                if (!b.referenceID.empty()) {
-                    cout << "This booking is already confirmed with Reference ID: " << b.referenceID << "\n";
-                    return;
-                }
-                b.referenceID = generateReferenceID();
-                cout << "Booking confirmed! Reference ID: " << b.referenceID << "\n";
-                updated = true;
-                break;
+    cout.flush();
+    vector<pid_t> children;
+    for (int worker = 0; worker < processes; ++worker) {
+        pid_t pid = fork();
+        if (pid < 0) throw runtime_error("fork failed");
+        if (pid == 0) {
+            int status = 0;
+            try {
+                runStressWorker(worker, operations, mode, roomCount);
+            } catch (const exception& e) {
+                cerr << "Worker " << worker << " failed: " << e.what() << "\n";
+                status = 1;
             }
+            _exit(status);
         }
+        children.push_back(pid);
+    }
+
+    bool ok = true;
+    for (pid_t pid : children) {
+        int status = 0;
+        waitpid(pid, &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) ok = false;
+    }
 
-        if (updated) saveBookings(bookings);
-        else cout << "No matching booking found to confirm.\n";
+    // Expected state: the union of what each worker kept
+    multiset<string> expected;
+    for (int worker = 0; worker < processes; ++worker) {
+        ifstream in("expected-" + to_string(worker) + ".txt");
+        string line;
+        while (getline(in, line)) expected.insert(line);
     }
-};
 
-// ----------------- Admin -----------------
+    HotelStore store;
+    store.setStorageMode(mode);
+    store.load();
+    multiset<string> actual;
+    map<int, vector<pair<int, int>>> staysByRoom;
+    map<string, int> referenceUses;
+    store.forEachBooking([&](const Booking& b) {
+        actual.insert(b.serialize());
+        staysByRoom[b.roomNumber].push_back({b.checkIn, b.checkOut()});
+        if (!b.referenceID.empty()) ++referenceUses[b.referenceID.str()];
+    });
 
-// Represents an admin user with management functionality
-class Admin : public User {
-public:
-    Admin(const string& name) : User(name) {}
+    size_t lost = 0, unexpected = 0, overlaps = 0, duplicateRefs = 0;
+    for (const auto& line : expected)
+        if (actual.count(line) < expected.count(line)) ++lost;
+    for (const auto& line : actual)
+        if (expected.count(line) < actual.count(line)) ++unexpected;
+    for (auto& [room, spans] : staysByRoom) {
+        sort(spans.begin(), spans.end());
+        for (size_t i = 1; i < spans.size(); ++i)
+            if (spans[i].first < spans[i - 1].second) ++overlaps;
+    }
+    for (const auto& [ref, uses] : referenceUses)
+        if (uses > 1) ++duplicateRefs;
+    ok = ok && lost == 0 && unexpected == 0 && overlaps == 0 && duplicateRefs == 0;
 
-    // Displays the admin menu and handles user interactions
-    void showMenu() override {
-        int choice;
-        do {
-            cout << "\n--- Admin Menu ---\n";
-            cout << "1. View All Rooms\n2. View All Bookings\n3. Add Room\n4. Delete Room\n5. Update Room Type\n6. Cancel Any Booking\n7. Logout\nChoice: ";
-            while (!(cin >> choice) || choice < 1 || choice > 7) {
-                cin.clear(); cin.ignore(numeric_limits<streamsize>::max(), '\n');
-                cout << "Invalid choice. Try again: ";
-            }
+    cout << (mode == StorageMode::Journal ? "journal" : "rewrite") << " mode, " << layout.describe() << ": "
+         << processes << " processes x " << operations << " operations, "
+         << expected.size() << " bookings expected, " << actual.size() << " found, "
+         << lost << " lost, " << unexpected << " unexpected, "
+         << overlaps << " overlapping, " << duplicateRefs << " duplicate reference IDs -> "
+         << (ok ? "PASS" : "FAIL") << "\n";
 
-            switch (choice) {
-                case 1: viewAllRooms(); break;
-                case 2: viewAllBookings(); break;
-                case 3: addRoom(); break;
-                case 4: deleteRoom(); break;
-                case 5: updateRoomType(); break;
-                case 6: cancelAnyBooking(); break;
-                case 7: cout << "Logging out...\n"; break;
-            }
-        } while (choice != 7);
+    filesystem::current_path(previousDir);
+    if (ok) filesystem::remove_all(dir);
+    else cout << "Data kept in " << dir << "\n";
+    return ok;
+}
+
+// ----------------- Server -----------------
+
+// The server answers batch commands over a Unix domain socket, one request
+// per line and one reply per request. Blank lines are ignored.
+//   book,<guest>,<room>,<YYYY-MM-DD>,<nights>   -> ok,<cost>
+//   cancel,<guest>,<room>                       -> ok
+//   confirm,<guest>,<room>                      -> ok,<reference ID>
+//   list,<guest>                                -> ok,<n> and n lines in bookings.txt format
+//   find,<reference ID>                         -> ok,<booking in bookings.txt format>
+//   cancel-ref,<reference ID>                   -> ok
+//   free,<YYYY-MM-DD>,<nights>                  -> ok,<n> and n lines <room>,<type>,<stay total>
+//   group,<guest>,<YYYY-MM-DD>,<nights>,<rooms> -> ok,<group reference ID>,<total>,<rooms booked>
+//   search,<YYYY-MM-DD>,<nights>[,<type>[,<max price>[,<limit>]]]
+//                                               -> ok,<n> and n lines <room>,<type>,<price>,<stay total>,
+//                                                  cheapest first; an empty type or a max price of 0 means any
+// A rejected request is answered with error,<reason> and changes nothing.
+// A client may keep its connection open for any number of requests.
+const char* const SERVER_SOCKET = "hotel.sock";
+
+// Fixed set of worker threads running jobs from a queue in arrival order
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t threads) {
+        for (size_t i = 0; i < threads; ++i) workers.emplace_back([this]() { work(); });
     }
 
-    // Displays all rooms, including availability
-    void viewAllRooms() {
-        auto rooms = loadRooms();
-        cout << "\nAll Rooms:\n";
-        for (const auto& r : rooms)
-            cout << "Room " << r.roomNumber << " (" << r.roomType << ") - "
-                 << (r.isAvailable ? "Available" : "Occupied") << "\n";
+    // Finishes the queued jobs, then stops the workers
+    ~ThreadPool() {
+        {
+            lock_guard<mutex> guard(lock);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& worker : workers) worker.join();
     }
 
-    // Displays all bookings in the system
-    void viewAllBookings() {
-        auto bookings = loadBookings();
-        cout << "\nAll Bookings:\n";
-        for (const auto& b : bookings)
-            cout << "Guest: " << b.guestName
-                 << ", Room " << b.roomNumber
-                 << ", Nights: " << b.nights
-                 << ", Total: $" << fixed << setprecision(2) << b.totalCost
-                 << ", Status: " << (b.referenceID.empty() ? "Unpaid" : "Paid") << "\n";
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void submit(function<void()> job) {
+        {
+            lock_guard<mutex> guard(lock);
+            jobs.push(move(job));
+        }
+        wake.notify_one();
     }
 
-    // Adds a new room to the system
-    void addRoom() {
-        auto rooms = loadRooms();
+private:
+    vector<thread> workers;
+    queue<function<void()>> jobs;
+    mutex lock;
+    condition_variable wake;
+    bool stopping = false;
 
-        // Display current rooms
-        cout << "\n--- Current Rooms in the System ---\n";
-        if (rooms.empty()) {
-            cout << "No rooms found.\n";
-        } else {
-            for (const auto& r : rooms) {
-                cout << "Room " << r.roomNumber << " (" << r.roomType << ") - "
-                     << (r.isAvailable ? "Available" : "Occupied") << "\n";
+    void work() {
+        while (true) {
+            function<void()> job;
+            {
+                unique_lock<mutex> guard(lock);
+                wake.wait(guard, [this]() { return stopping || !jobs.empty(); });
+                if (jobs.empty()) return;
+                job = move(jobs.front());
+                jobs.pop();
             }
+            job();
         }
+    }
+};
 
-        // Get new room number
-        int num;
-        cout << "\nEnter new room number (0 to cancel): ";
-        while (!(cin >> num) || num < 0) {
-            cin.clear(); cin.ignore(numeric_limits<streamsize>::max(), '\n');
-            cout << "Invalid input. Enter a valid room number (0 to cancel): ";
+// Answers one request line. Updates lock only the room they name, so
+// requests for different rooms are served side by side; lookups share
+// the store with each other.
+string serveRequest(HotelStore& store, const string& line) {
+    vector<string> fields = splitCommand(line);
+    const string& command = fields[0];
+    try {
+        if (command == "book" || command == "cancel" || command == "confirm") {
+            if (fields.size() < 3) throw runtime_error("expected a guest and a room");
+            string detail;
+            store.withRoom(batchRoomNumber(fields[2]), [&]() { detail = runBatchCommand(store, fields); });
+            return detail.empty() ? "ok\n" : "ok," + detail + "\n";
         }
 
-        if (num == 0) {
-            cout << "Room addition cancelled.\n";
-            return;
+        if (command == "group") {
+            // Takes every room at once, so no single-room update can slip in between the checks
+            string detail;
+            store.withBatch([&]() { detail = runBatchCommand(store, fields); });
+            return "ok," + detail + "\n";
         }
 
-        // Check for duplicate room number
-        auto it = find_if(rooms.begin(), rooms.end(), [num](const Room& r) {
-            return r.roomNumber == num;
-        });
+        if (command == "find") return "ok," + store.read([&]() { return runBatchCommand(store, fields); }) + "\n";
 
-        if (it != rooms.end()) {
-            cout << "Room number already exists. Cannot add duplicate.\n";
-            return;
+        if (command == "cancel-ref") {
+            // Find the booking's room, then lock it; the command checks the booking again under the lock
+            string referenceID = fields.size() == 2 ? fields[1] : "";
+            if (!normalizeReferenceID(referenceID)) throw runtime_error("invalid reference ID");
+            if (isGroupReferenceID(referenceID)) {
+                store.withBatch([&]() { runBatchCommand(store, fields); });
+                return "ok\n";
+            }
+            int roomNum = store.read([&]() {
+                const Booking* b = store.findBookingByReference(referenceID);
+                return b ? b->roomNumber : 0;
+            });
+            if (roomNum == 0) throw runtime_error("no booking with this reference ID");
+            store.withRoom(roomNum, [&]() { runBatchCommand(store, fields); });
+            return "ok\n";
         }
 
-        // Get room type
-        cin.ignore();
-        string type;
-        while (true) {
-            cout << "Enter room type (Single/Double/Suite): ";
-            getline(cin, type);
+        if (command == "list") {
+            if (fields.size() != 2) throw runtime_error("expected 1 arguments");
+            return store.read([&]() {
+                string lines;
+                size_t count = 0;
+                store.forEachBookingOf(fields[1], [&](const Booking& b) {
+                    lines += b.serialize() + "\n";
+                    ++count;
+                });
+                return "ok," + to_string(count) + "\n" + lines;
+            });
+        }
 
-            transform(type.begin(), type.end(), type.begin(), ::tolower);
-            type[0] = toupper(type[0]);
+        if (command == "free") {
+            if (fields.size() != 3) throw runtime_error("expected 2 arguments");
+            int checkIn, nights;
+            if (!parseDate(fields[1], checkIn)) throw runtime_error("check-in must be YYYY-MM-DD");
+            if (!parseNumber(fields[2], nights) || nights < 1 || nights > 30) throw runtime_error("nights must be 1 to 30");
+            return store.read([&]() {
+                vector<const Room*> rooms = store.freeRooms(checkIn, checkIn + nights);
+                string lines = "ok," + to_string(rooms.size()) + "\n";
+                for (const Room* r : rooms)
+                    lines += to_string(r->roomNumber) + "," + r->roomType.str() + "," +
+                             formatMoney(pricing().quote(*r, checkIn, nights)) + "\n";
+                return lines;
+            });
+        }
 
-            if (type == "Single" || type == "Double" || type == "Suite") break;
-            cout << "Invalid room type. Please enter Single, Double, or Suite.\n";
+        if (command == "search") {
+            RoomQuery query = parseRoomSearch(fields, 1);
+            int checkIn = query.checkIn, nights = query.checkOut - query.checkIn;
+            return store.read([&]() {
+                vector<const Room*> rooms = store.searchRooms(query);
+                string lines = "ok," + to_string(rooms.size()) + "\n";
+                for (const Room* r : rooms)
+                    lines += to_string(r->roomNumber) + "," + r->roomType.str() + "," + formatCents(r->price.cents()) + "," +
+                             formatMoney(pricing().quote(*r, checkIn, nights)) + "\n";
+                return lines;
+            });
         }
 
-        // Assign price based on type
-        // Note: Prices here ($100, $180, $300) differ from PricingStrategy ($100, $150, $250)
-        double price;
-        if (type == "Single") price = 100.0;
-        else if (type == "Double") price = 180.0;
-        else if (type == "Suite") price = 300.0;
+        throw runtime_error("unknown command");
+    } catch (const exception& e) {
+        return "error," + string(e.what()) + "\n";
+    }
+}
 
-        Room newRoom = { num, type, price, true }; // New room is available by default
+// Writes all of text to a socket; returns false once the peer has gone
+bool sendAll(int fd, string_view text) {
+    while (!text.empty()) {
+        ssize_t n = send(fd, text.data(), text.size(), MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        text.remove_prefix(static_cast<size_t>(n));
+    }
+    return true;
+}
 
-        // Note: Appending directly to file; consider loading, modifying, and rewriting for consistency
-        ofstream outFile("rooms.txt", ios::app);
-        if (!outFile) {
-            cout << "Error opening rooms.txt for writing.\n";
-            return;
+// Answers the requests of one client until it disconnects. Requests that
+// arrive together are answered with a single write.
+void serveConnection(HotelStore& store, int fd) {
+    string received, replies;
+    char chunk[1 << 14];
+    while (true) {
+        ssize_t n = ::read(fd, chunk, sizeof chunk);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return;
+        received.append(chunk, static_cast<size_t>(n));
+
+        size_t consumed = 0;
+        size_t nl;
+        while ((nl = received.find('\n', consumed)) != string::npos) {
+            string line = received.substr(consumed, nl - consumed);
+            consumed = nl + 1;
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            if (line.find_first_not_of(" \t") == string::npos) continue;
+            replies += serveRequest(store, line);
         }
+        received.erase(0, consumed);
+        if (!sendAll(fd, replies)) return;
+        replies.clear();
+    }
+}
+
+volatile sig_atomic_t serverStopping = 0;
+
+void stopServer(int) { serverStopping = 1; }
 
-        outFile << newRoom.serialize() << endl;
-        outFile.close();
+// Opens a connected stream socket to the server at path, or returns -1
+int connectToServer(const string& path) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof address.sun_path) throw runtime_error("Socket path too long: " + path);
+    memcpy(address.sun_path, path.c_str(), path.size() + 1);
 
-        cout << "Room added successfully.\n";
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) throw runtime_error("Unable to create a socket: " + string(strerror(errno)));
+    if (connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof address) != 0) {
+        ::close(fd);
+        return -1;
     }
+    return fd;
+}
 
-    // Deletes a room from the system
-    void deleteRoom() {
-        auto rooms = loadRooms();
-        auto bookings = loadBookings();
+// Serves the loaded store on a Unix domain socket at path until SIGINT or
+// SIGTERM, using threads workers. A worker serves one connection at a
+// time, so clients beyond the number of workers wait for one to free up.
+void runServer(HotelStore& store, const string& path, size_t threads) {
+    int running = connectToServer(path);
+    if (running >= 0) {
+        ::close(running);
+        throw runtime_error("A server is already listening on " + path);
+    }
+    ::unlink(path.c_str()); // Left behind by a server that did not shut down cleanly
 
-        // Display current rooms
-        cout << "\n--- Current Rooms in the System ---\n";
-        if (rooms.empty()) {
-            cout << "No rooms found.\n";
-            return;
-        }
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) throw runtime_error("Unable to create a socket: " + string(strerror(errno)));
+    if (bind(listener, reinterpret_cast<const sockaddr*>(&address), sizeof address) != 0 || listen(listener, 128) != 0) {
+        string reason = strerror(errno);
+        ::close(listener);
+        throw runtime_error("Unable to listen on " + path + ": " + reason);
+    }
 
-        for (const auto& r : rooms) {
-            cout << "Room " << r.roomNumber << " (" << r.roomType << ") - "
-                 << (r.isAvailable ? "Available" : "Occupied") << "\n";
-        }
+    struct sigaction stop{};
+    stop.sa_handler = stopServer;
+    sigemptyset(&stop.sa_mask);
+    sigaction(SIGINT, &stop, nullptr);
+    sigaction(SIGTERM, &stop, nullptr);
+    cerr << "Serving on " << path << " with " << threads << " worker threads\n";
 
-        // Get room number to delete
-        int num;
-        cout << "\nEnter room number to delete (0 to cancel): ";
-        while (!(cin >> num) || num < 0) {
-            cin.clear(); cin.ignore(numeric_limits<streamsize>::max(), '\n');
-            cout << "Invalid. Enter a valid room number (0 to cancel): ";
+    mutex connectionsLock;
+    set<int> connections; // Open client sockets, so shutting down can wake their workers
+    size_t served = 0;
+    {
+        ThreadPool pool(threads);
+        while (!serverStopping) {
+            // Poll with a timeout rather than block in accept(), which a
+            // signal arriving just before the call would not interrupt
+            pollfd ready{listener, POLLIN, 0};
+            if (poll(&ready, 1, 200) <= 0) continue;
+            int client = accept(listener, nullptr, nullptr);
+            if (client < 0) continue;
+            {
+                lock_guard<mutex> guard(connectionsLock);
+                connections.insert(client);
+            }
+            ++served;
+            pool.submit([&store, &connectionsLock, &connections, client]() {
+                try {
+                    serveConnection(store, client);
+                } catch (const exception& e) {
+                    cerr << "Connection failed: " << e.what() << "\n";
+                }
+                lock_guard<mutex> guard(connectionsLock);
+                connections.erase(client);
+                ::close(client);
+            });
         }
 
-        if (num == 0) {
-            cout << "Deletion cancelled. Returning to menu...\n";
-            return;
-        }
+        ::close(listener);
+        lock_guard<mutex> guard(connectionsLock);
+        for (int client : connections) shutdown(client, SHUT_RDWR);
+    }
+    ::unlink(path.c_str());
+    cerr << "Server stopped after " << served << " connections\n";
+}
 
-        // Check if room has active bookings
-        bool hasBooking = any_of(bookings.begin(), bookings.end(),
-                                 [num](const Booking& b) { return b.roomNumber == num; });
+// One client connection to the server, for the load generator
+class ServerConnection {
+public:
+    explicit ServerConnection(const string& path) : fd(connectToServer(path)) {
+        if (fd < 0) throw runtime_error("No server is listening on " + path);
+    }
 
-        if (hasBooking) {
-            cout << "Cannot delete room " << num << " because it has an active booking.\n";
-            return;
-        }
+    ~ServerConnection() { ::close(fd); }
 
-        // Remove room
-        auto it = remove_if(rooms.begin(), rooms.end(),
-            [num](const Room& r) { return r.roomNumber == num; });
+    ServerConnection(const ServerConnection&) = delete;
+    ServerConnection& operator=(const ServerConnection&) = delete;
 
-        if (it != rooms.end()) {
-            rooms.erase(it, rooms.end());
-            saveRooms(rooms);
-            cout << "Room " << num << " deleted successfully.\n";
-        } else {
-            cout << "Room number not found. Nothing deleted.\n";
+    // Sends one request and returns the first line of its reply; the
+    // further lines of a list, free or search reply are stored in body
+    string request(const string& line, vector<string>* body = nullptr) {
+        if (!sendAll(fd, line + "\n")) throw runtime_error("Server closed the connection");
+        string reply = readLine();
+        size_t count = 0;
+        if (reply.rfind("ok,", 0) == 0 && (line.rfind("list,", 0) == 0 || line.rfind("free,", 0) == 0 ||
+                                          line.rfind("search,", 0) == 0))
+            parseNumber(reply.substr(3), count);
+        for (size_t i = 0; i < count; ++i) {
+            string extra = readLine();
+            if (body) body->push_back(move(extra));
         }
+        return reply;
     }
 
-    // Updates the type and price of an existing room
-    void updateRoomType() {
-        auto rooms = loadRooms();
+private:
+    int fd;
+    string received;
 
-        // Display all rooms
-        cout << "\n--- Current Rooms in the System ---\n";
-        if (rooms.empty()) {
-            cout << "No rooms available to update.\n";
-            return;
+    string readLine() {
+        size_t nl;
+        while ((nl = received.find('\n')) == string::npos) {
+            char chunk[1 << 14];
+            ssize_t n = ::read(fd, chunk, sizeof chunk);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) throw runtime_error("Server closed the connection");
+            received.append(chunk, static_cast<size_t>(n));
         }
+        string line = received.substr(0, nl);
+        received.erase(0, nl + 1);
+        return line;
+    }
+};
 
-        for (const auto& r : rooms) {
-            cout << "Room " << r.roomNumber << " (" << r.roomType << ") - "
-                 << (r.isAvailable ? "Available" : "Occupied") << "\n";
+// Measures how the server at path scales: for 1, 2, 4, ... up to
+// maxClients concurrent clients, each client spends seconds running
+// book, list, confirm and cancel cycles over rooms of its own, and the
+// requests per second and latencies are reported per step. Every stay is
+// cancelled again, far in the future, so the hotel is left as it was
+// apart from the reference numbers used. Start the server with --threads
+// to choose how many cores it may use.
+void runLoadTest(const string& path, size_t maxClients, double seconds) {
+    const int checkIn = today() + 20000;
+    const string stayDate = formatDate(checkIn);
+    vector<int> roomNumbers;
+    {
+        ServerConnection probe(path);
+        vector<string> lines;
+        string reply = probe.request("free," + stayDate + ",2", &lines);
+        if (reply.rfind("ok,", 0) != 0) throw runtime_error("Server refused to list rooms: " + reply);
+        for (const auto& line : lines) {
+            int roomNum;
+            if (parseNumber(splitCommand(line)[0], roomNum)) roomNumbers.push_back(roomNum);
         }
+    }
+    if (roomNumbers.size() < maxClients) throw runtime_error("Need at least one free room per client");
 
-        // Get room number
-        string input;
-        int num;
-        while (true) {
-            cout << "\nEnter room number to update (0 to cancel): ";
-            cin >> input;
-            stringstream ss(input);
-            if ((ss >> num) && ss.eof() && num >= 0) break;
-            cout << "Invalid input. Enter a valid room number (0 to cancel): ";
+    cout << "Load test: " << path << ", " << roomNumbers.size() << " rooms, " << seconds << " s per step\n";
+    cout << left << setw(10) << "Clients" << right << setw(12) << "requests" << setw(14) << "req/s"
+         << setw(14) << "p50" << setw(14) << "p99" << setw(10) << "errors" << "\n";
+
+    vector<size_t> steps;
+    for (size_t clients = 1; clients < maxClients; clients *= 2) steps.push_back(clients);
+    steps.push_back(maxClients);
+
+    for (size_t clients : steps) {
+        vector<LatencyRecorder> latencies(clients, LatencyRecorder("request"));
+        vector<size_t> errors(clients, 0);
+        vector<thread> workers;
+        auto start = chrono::steady_clock::now();
+        auto deadline = start + chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(seconds));
+
+        for (size_t c = 0; c < clients; ++c) {
+            workers.emplace_back([&, c]() {
+                try {
+                    ServerConnection connection(path);
+                    const string guest = "Load Client " + to_string(c + 1);
+                    auto timed = [&](const string& line) {
+                        string reply;
+                        latencies[c].sample([&]() { reply = connection.request(line); });
+                        if (reply.rfind("ok", 0) != 0) ++errors[c];
+                    };
+                    // Each client has every clients-th room to itself
+                    size_t i = c;
+                    while (chrono::steady_clock::now() < deadline) {
+                        string room = to_string(roomNumbers[i]);
+                        timed("book," + guest + "," + room + "," + stayDate + ",2");
+                        timed("list," + guest);
+                        timed("confirm," + guest + "," + room);
+                        timed("cancel," + guest + "," + room);
+                        i += clients;
+                        if (i >= roomNumbers.size()) i = c;
+                    }
+                } catch (const exception& e) {
+                    cerr << "Load client failed: " << e.what() << "\n";
+                    ++errors[c];
+                }
+            });
         }
+        for (auto& worker : workers) worker.join();
+        chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
 
-        if (num == 0) {
-            cout << "Update cancelled. Returning to menu...\n";
-            return;
+        LatencyRecorder all("request");
+        size_t failed = 0;
+        for (size_t c = 0; c < clients; ++c) {
+            all.merge(latencies[c]);
+            failed += errors[c];
         }
+        cout << left << setw(10) << clients << right << setw(12) << all.operations()
+             << setw(14) << fixed << setprecision(0) << all.operations() / elapsed.count()
+             << setw(14) << formatDuration(all.latency(0.50))
+             << setw(14) << formatDuration(all.latency(0.99))
+             << setw(10) << failed << "\n";
+    }
+}
 
-        // Find room
-        auto it = find_if(rooms.begin(), rooms.end(),
-                          [num](const Room& r) { return r.roomNumber == num; });
+// ----------------- Properties -----------------
 
-        if (it == rooms.end()) {
-            cout << "Room number not found.\n";
-            return;
-        }
+// Several hotels can be run from one directory. Each property keeps a data
+// directory of its own, properties/<name>/, laid out like a single hotel's
+// (rooms.txt and bookings.txt or shards, journal, hotel.lock), so room
+// numbers only need to be unique within a property, and each property is
+// loaded, locked and written on its own. ref_counter.txt and rates.txt
+// stay in the top directory, so reference IDs are unique across
+// properties and all of them price stays from the same rate table.
+const char* const PROPERTIES_DIR = "properties";
 
-        // Get new room type
-        cin.ignore();
-        string type;
-        while (true) {
-            cout << "Enter new room type (Single/Double/Suite): ";
-            getline(cin, type);
+// Data directory of the property called name
+string propertyDirectory(const string& name) {
+    if (name.empty() || name.find('/') != string::npos || name == "." || name == "..")
+        throw runtime_error("Invalid property name: " + name);
+    return string(PROPERTIES_DIR) + "/" + name;
+}
 
-            transform(type.begin(), type.end(), type.begin(), ::tolower);
-            if (!type.empty()) type[0] = toupper(type[0]);
+// A room found by a search across properties
+struct PropertyOffer {
+    uint16_t property; // See PropertySet::name()
+    int roomNumber;
+    RoomType roomType;
+    Money price;       // Per night
+    Money stayTotal;
+};
 
-            if (type == "Single" || type == "Double" || type == "Suite") break;
-            cout << "Invalid room type. Please enter Single, Double, or Suite.\n";
+// Every property under properties/, opened side by side. Properties are
+// numbered from 1 in name order; that number is what their rooms and
+// bookings carry as their property. Searches run as one task per property
+// on a thread pool and their results are merged.
+class PropertySet {
+public:
+    // Loads every property, several at a time
+    PropertySet(StorageMode mode, size_t threads) : pool(threads) {
+        error_code ec;
+        for (const auto& entry : filesystem::directory_iterator(PROPERTIES_DIR, ec))
+            if (entry.is_directory()) names.push_back(entry.path().filename().string());
+        if (names.empty()) throw runtime_error(string("No properties found under ") + PROPERTIES_DIR + "/");
+        if (names.size() > numeric_limits<uint16_t>::max()) throw runtime_error("Too many properties");
+        sort(names.begin(), names.end());
+
+        for (size_t i = 0; i < names.size(); ++i) {
+            stores.push_back(make_unique<HotelStore>(propertyDirectory(names[i])));
+            stores.back()->setStorageMode(mode);
+            stores.back()->setProperty(static_cast<uint16_t>(i + 1));
         }
+        forEachProperty([&](size_t i) { stores[i]->load(); });
+    }
 
-        // Update room type and price
-        // Note: Prices here ($100, $180, $300) differ from PricingStrategy ($100, $150, $250)
-        it->roomType = type;
-        if (type == "Single") it->price = 100.0;
-        else if (type == "Double") it->price = 180.0;
-        else if (type == "Suite") it->price = 300.0;
+    size_t size() const { return stores.size(); }
 
-        saveRooms(rooms);
-        cout << "Room " << num << " type updated successfully to " << type
-             << " with new price $" << fixed << setprecision(2) << it->price << ".\n";
+    const string& name(uint16_t property) const { return names.at(property - 1); }
+
+    // Rooms matching query in every property, merged in price order (then
+    // by property and room number), at most query.limit of them. Each
+    // property first picks up the changes its own processes have made, then
+    // answers with its own best query.limit rooms, so no property holds up
+    // the others or has to hand over more than could make the cut.
+    vector<PropertyOffer> search(const RoomQuery& query) {
+        STATS_TIME("properties.search");
+        int nights = query.checkIn == NO_DATE ? 1 : query.checkOut - query.checkIn;
+        vector<vector<PropertyOffer>> found(stores.size());
+        forEachProperty([&](size_t i) {
+            HotelStore& store = *stores[i];
+            store.refresh();
+            store.read([&]() {
+                for (const Room* r : store.searchRooms(query))
+                    found[i].push_back({r->property, r->roomNumber, r->roomType, r->price,
+                                        pricing().quote(*r, query.checkIn, nights)});
+            });
+        });
+
+        vector<PropertyOffer> merged;
+        for (const auto& offers : found) merged.insert(merged.end(), offers.begin(), offers.end());
+        auto cheaper = [&](const PropertyOffer& a, const PropertyOffer& b) {
+            if (a.price.cents() != b.price.cents())
+                return query.descending ? a.price.cents() > b.price.cents() : a.price.cents() < b.price.cents();
+            return make_pair(a.property, a.roomNumber) < make_pair(b.property, b.roomNumber);
+        };
+        size_t keep = min(query.limit, merged.size());
+        partial_sort(merged.begin(), merged.begin() + static_cast<ptrdiff_t>(keep), merged.end(), cheaper);
+        merged.resize(keep);
+        return merged;
     }
 
-    // Cancels any booking in the system
-    void cancelAnyBooking() {
-        auto bookings = loadBookings();
-        if (bookings.empty()) {
-            cout << "\nNo bookings found to cancel.\n";
-            return;
-        }
+private:
+    vector<string> names;
+    vector<unique_ptr<HotelStore>> stores;
+    ThreadPool pool;
 
-        // Display all bookings
-        cout << "\n--- Current Bookings ---\n";
-        for (const auto& b : bookings) {
-            cout << "Guest: " << b.guestName
-                 << ", Room " << b.roomNumber
-                 << ", Nights: " << b.nights
-                 << ", Total: $" << fixed << setprecision(2) << b.totalCost
-                 << ", Status: " << (b.referenceID.empty() ? "Unpaid" : "Paid") << "\n";
+    // Runs task(i) for every property on the pool and waits for all of
+    // them; rethrows the first exception a task threw
+    void forEachProperty(const function<void(size_t)>& task) {
+        mutex doneLock;
+        condition_variable done;
+        size_t left = stores.size();
+        exception_ptr failure;
+        for (size_t i = 0; i < stores.size(); ++i) {
+            pool.submit([&, i]() {
+                exception_ptr error;
+                try {
+                    task(i);
+                } catch (...) {
+                    error = current_exception();
+                }
+                lock_guard<mutex> guard(doneLock);
+                if (error && !failure) failure = error;
+                if (--left == 0) done.notify_all();
+            });
         }
+        unique_lock<mutex> guard(doneLock);
+        done.wait(guard, [&]() { return left == 0; });
+        if (failure) rethrow_exception(failure);
+    }
+};
 
-        // Get room number to cancel
-        int roomNum;
-        cout << "\nEnter room number to cancel booking (0 to cancel): ";
-        while (!(cin >> roomNum) || roomNum < 0) {
-            cin.clear(); cin.ignore(numeric_limits<streamsize>::max(), '\n');
-            cout << "Invalid input. Enter a valid room number (0 to cancel): ";
-        }
+// Answers one search across every property and prints the rooms found,
+// one <property>,<room>,<type>,<price>,<stay total> line each
+void runPropertySearch(const string& spec, StorageMode mode, size_t threads) {
+    RoomQuery query = parseRoomSearch(splitCommand("search," + spec), 1);
+    PropertySet properties(mode, threads);
+    auto start = chrono::steady_clock::now();
+    vector<PropertyOffer> offers = properties.search(query);
+    chrono::duration<double, micro> elapsed = chrono::steady_clock::now() - start;
 
-        if (roomNum == 0) {
-            cout << "Cancellation aborted. Returning to menu...\n";
-            return;
+    string out;
+    for (const PropertyOffer& o : offers)
+        out += properties.name(o.property) + "," + to_string(o.roomNumber) + "," + o.roomType.str() + "," +
+               formatCents(o.price.cents()) + "," + formatCents(o.stayTotal.cents()) + "\n";
+    cout << out;
+    cerr << offers.size() << " rooms from " << properties.size() << " properties in " << formatDuration(elapsed.count()) << "\n";
+}
+
+// Times searches across count generated properties of roomCount rooms and
+// bookingCount bookings each, answered one property at a time and then on
+// every core
+void runPropertyBenchmark(size_t count, size_t roomCount, size_t bookingCount) {
+    char dirTemplate[] = "/tmp/hotel-properties-XXXXXX";
+    if (!mkdtemp(dirTemplate)) throw runtime_error("Unable to create scratch directory");
+    string dir = dirTemplate;
+    string previousDir = filesystem::current_path().string();
+    filesystem::current_path(dir);
+
+    try {
+        for (size_t i = 0; i < count; ++i) {
+            char name[32];
+            snprintf(name, sizeof name, "p%03zu", i);
+            filesystem::create_directories(propertyDirectory(name));
+            generateHotelData(roomCount, bookingCount, static_cast<unsigned>(42 + i), propertyDirectory(name));
         }
 
-        // Remove booking
-        auto it = remove_if(bookings.begin(), bookings.end(),
-            [roomNum](const Booking& b) { return b.roomNumber == roomNum; });
-
-        if (it != bookings.end()) {
-            bookings.erase(it, bookings.end());
-            auto rooms = loadRooms();
-            for (auto& r : rooms)
-                if (r.roomNumber == roomNum)
-                    r.isAvailable = true;
-
-            saveRooms(rooms);
-            saveBookings(bookings);
-            cout << "Booking for room " << roomNum << " canceled successfully.\n";
-        } else {
-            cout << "No booking found for room number " << roomNum << ".\n";
+        cout << "Property benchmark: " << count << " properties of " << roomCount << " rooms and " << bookingCount
+             << " bookings\n";
+        LatencyRecorder::printHeader();
+        size_t cores = max(1u, thread::hardware_concurrency());
+        for (size_t threads : {size_t(1), cores}) {
+            PropertySet properties(StorageMode::Journal, threads);
+            for (size_t limit : {size_t(10), numeric_limits<size_t>::max()}) {
+                LatencyRecorder searches("search " + string(limit == 10 ? "top 10" : "all") + ", " + to_string(threads) + " thr");
+                size_t found = 0;
+                for (int day = 0; day < 30; ++day) {
+                    RoomQuery query;
+                    query.checkIn = today() + day;
+                    query.checkOut = query.checkIn + 3;
+                    query.limit = limit;
+                    searches.sample([&]() { found += properties.search(query).size(); });
+                }
+                searches.report();
+                if (found == 0) cout << "(nothing found)\n";
+            }
+            if (cores == 1) break;
         }
+    } catch (...) {
+        filesystem::current_path(previousDir);
+        filesystem::remove_all(dir);
+        throw;
     }
-};
+    filesystem::current_path(previousDir);
+    filesystem::remove_all(dir);
+}
 
-// ----------------- Login -----------------
+// ----------------- Main -----------------
 
-// Handles user login and returns appropriate User object
-User* login() {
-    int choice;
-    cout << "\nLogin as:\n1. Admin\n2. Guest\nChoice: ";
-    while (!(cin >> choice) || (choice != 1 && choice != 2)) {
-        cin.clear(); cin.ignore(numeric_limits<streamsize>::max(), '\n');
-        cout << "Invalid. Enter 1 for Admin, 2 for Guest: ";
-    }
+#if HOTEL_STATS
+string statsJsonPath; // --stats-json
 
-    string name, pass;
-    cin.ignore();
+// Dumps the statistics when the process exits normally
+void dumpStatsAtExit() {
+    writeStatsJson(statsJsonPath);
+}
 
-    if (choice == 1) {
-        cout << "Username: "; getline(cin, name);
-        cout << "Password: "; getline(cin, pass);
-        if (name == "admin" && pass == "123") return new Admin(name);
-        else cout << "Invalid credentials.\n";
-    } else {
-        cout << "Enter your name: ";
-        getline(cin, name);
-        if (!name.empty()) return new Guest(name);
-        else cout << "Name cannot be empty.\n";
+// Dumps the statistics on every SIGUSR1, and on SIGINT/SIGTERM too when
+// stopOnInterrupt is set, before exiting the way the signal would have.
+// Must run before any other thread starts so they all inherit the mask
+// that leaves these signals to the watcher alone.
+void startStatsSignalWatcher(bool stopOnInterrupt) {
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGUSR1);
+    if (stopOnInterrupt) {
+        sigaddset(&signals, SIGINT);
+        sigaddset(&signals, SIGTERM);
     }
-
-    return nullptr;
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+    thread([signals] {
+        while (true) {
+            int sig;
+            if (sigwait(&signals, &sig) != 0) continue;
+            writeStatsJson(statsJsonPath);
+            if (sig != SIGUSR1) _exit(128 + sig);
+        }
+    }).detach();
 }
-
-// ----------------- Main -----------------
+#endif
 
 // Main entry point for the hotel reservation system
-int main() {
-    cout << "=== HOTEL RESERVATION SYSTEM ===\n";
+// Options:
+//   --journal           append changes to hotel.journal instead of rewriting the data files
+//   --compact-every N   journal length that triggers a background compaction (default 1000, 0 = never)
+//   --snapshot          keep a binary hotel.snap next to the text files and start from it when current
+//   --bench-parse [N]   compare the text parsers on N synthetic records (default 200000) and exit
+//   --bench-memory      report the bytes per room and booking record of the hotel here (or of
+//                          --property's) and exit
+//   --bench-views [B] [S]  time bookings for S seconds (default 2) alone and while reports run, on a
+//                          generated hotel of B bookings (default 1000000), and exit
+//   --batch [FILE]      run the commands in FILE (default: standard input) as one batch and exit
+//   --generate-data R B [SEED]  write a synthetic hotel of R rooms and B bookings to the current directory
+//                          (or to --property's, creating it) and exit; refuses to replace existing data
+//                          files unless --force is given
+//   --bench [R] [B] [RUNS] [FLOWS]  time loads, saves, pricing and the booking flows on a generated
+//                          hotel (default 10000 rooms, 100000 bookings, 5 runs, 100 flows) and exit
+//   --stress-test [P] [N]  run P processes x N operations against a scratch directory in both
+//                          storage modes and data layouts and verify no booking is lost (default 8 x 500)
+//   --report            print the occupancy and revenue report for tonight and exit
+//   --serve             answer book/cancel/confirm/list requests on a Unix domain socket until interrupted
+//   --threads N         worker threads of the server (default: one per core)
+//   --socket PATH       socket of the server and the load test (default hotel.sock)
+//   --load-test [C] [S] measure the running server with 1, 2, 4, ... up to C clients for S seconds
+//                          each (default one client per core, 2 seconds) and exit
+//   --stats-json FILE   write the timers and counters as JSON to FILE on exit and on SIGUSR1
+//   --durability LEVEL  none (default), strict (every change synced to disk before it is
+//                          acknowledged) or group (changes within a short window share a sync)
+//   --group-window US   how long a group sync waits for more changes (default 2000 microseconds)
+//   --group-size N      changes that end the group window early (default 64)
+//   --migrate-layout KEY  move the data files to another layout and exit: single (rooms.txt and
+//                          bookings.txt), floor (one shard per 100 room numbers) or N room numbers per
+//                          shard. Stop every other process using the directory first.
+//   --import-rooms FILE add the rooms listed in a CSV (- for standard input) in one batch, report
+//                          the rejected rows and exit
+//   --bench-durability [T] [N]  time T threads x N commits in each storage mode and durability
+//                          level (default 8 x 400) and exit
+//   --property NAME     use the data files of property NAME, in properties/NAME, instead of those in the
+//                          current directory (give each property's server a --socket of its own); not
+//                          with the other benchmarks, --stress-test, --load-test or --search-properties
+//   --search-properties <YYYY-MM-DD>,<nights>[,<type>[,<max price>[,<limit>]]]  search every property
+//                          under properties/ at once, on --threads threads, print the rooms found and exit
+//   --bench-properties [P] [R] [B]  time searches across P generated properties of R rooms and B bookings
+//                          (default 50 x 200 rooms, 2000 bookings) and exit
+int main(int argc, char* argv[]) {
     try {
+        StorageMode mode = StorageMode::Rewrite;
+        size_t compactEvery = 1000;
+        bool snapshots = false;
+        string batchPath;
+        bool serve = false;
+        bool report = false;
+        size_t threads = max(1u, thread::hardware_concurrency());
+        string socketPath = SERVER_SOCKET;
+        size_t loadClients = 0;
+        double loadSeconds = 2;
+        string statsPath;
+        string migrateTo;
+        string importPath;
+        string propertyName;
+        string propertySearch;
+        Durability durability = Durability::None;
+        long groupWindow = 2000;
+        size_t groupSize = 64;
+        bool generate = false;
+        size_t generateRooms = 0, generateBookings = 0;
+        unsigned generateSeed = 42;
+        bool force = false;
+        string task;             // A benchmark or the stress test, run on its own once every option is read
+        vector<string> taskArgs; // Its numeric arguments
+        for (int i = 1; i < argc; ++i) {
+            string arg = argv[i];
+            if (arg == "--journal") mode = StorageMode::Journal;
+            else if (arg == "--compact-every" && i + 1 < argc) compactEvery = stoul(argv[++i]);
+            else if (arg == "--snapshot") snapshots = true;
+            else if (arg == "--serve") serve = true;
+            else if (arg == "--report") report = true;
+            else if (arg == "--threads" && i + 1 < argc) threads = max<size_t>(1, stoul(argv[++i]));
+            else if (arg == "--socket" && i + 1 < argc) socketPath = argv[++i];
+            else if (arg == "--stats-json" && i + 1 < argc) statsPath = argv[++i];
+            else if (arg == "--durability" && i + 1 < argc) durability = parseDurability(argv[++i]);
+            else if (arg == "--group-window" && i + 1 < argc) groupWindow = stol(argv[++i]);
+            else if (arg == "--group-size" && i + 1 < argc) groupSize = stoul(argv[++i]);
+            else if (arg == "--migrate-layout" && i + 1 < argc) migrateTo = argv[++i];
+            else if (arg == "--import-rooms" && i + 1 < argc) importPath = argv[++i];
+            else if (arg == "--property" && i + 1 < argc) propertyName = argv[++i];
+            else if (arg == "--search-properties" && i + 1 < argc) propertySearch = argv[++i];
+            else if (arg == "--bench" || arg == "--bench-parse" || arg == "--bench-memory" || arg == "--bench-views" ||
+                     arg == "--bench-durability" || arg == "--bench-properties" || arg == "--stress-test") {
+                task = arg;
+                while (i + 1 < argc && isdigit(static_cast<unsigned char>(argv[i + 1][0]))) taskArgs.push_back(argv[++i]);
+            }
+            else if (arg == "--load-test") {
+                loadClients = threads;
+                if (i + 1 < argc && isdigit(static_cast<unsigned char>(argv[i + 1][0]))) loadClients = max<size_t>(1, stoul(argv[++i]));
+                if (i + 1 < argc && isdigit(static_cast<unsigned char>(argv[i + 1][0]))) loadSeconds = stod(argv[++i]);
+            }
+            else if (arg == "--batch") batchPath = i + 1 < argc && string(argv[i + 1]).rfind("--", 0) != 0 ? argv[++i] : "-";
+            else if (arg == "--generate-data" && i + 2 < argc) {
+                generate = true;
+                generateRooms = stoul(argv[++i]);
+                generateBookings = stoul(argv[++i]);
+                if (i + 1 < argc && isdigit(static_cast<unsigned char>(argv[i + 1][0]))) generateSeed = stoul(argv[++i]);
+            }
+            else if (arg == "--force") force = true;
+            else throw runtime_error("Unknown option: " + arg);
+        }
+
+        // A property's data directory serves every mode that reads or writes
+        // one hotel; the benchmarks and the stress test build their own in a
+        // scratch directory, and the load test and the property search talk
+        // to servers or to every property, so --property with them is refused
+        string dataDir = propertyName.empty() ? "" : propertyDirectory(propertyName);
+        if (!propertyName.empty()) {
+            string without = !task.empty() && task != "--bench-memory" ? task
+                              : loadClients > 0                       ? "--load-test"
+                              : !propertySearch.empty()               ? "--search-properties"
+                                                                      : "";
+            if (!without.empty()) throw runtime_error("--property cannot be used with " + without);
+            if (generate) filesystem::create_directories(dataDir);
+            else if (!filesystem::is_directory(dataDir)) throw runtime_error("No property called " + propertyName);
+        }
+
+        if (generate) {
+            // A property shares the top directory's ref_counter.txt, which is
+            // never replaced from there
+            vector<string> names = {"rooms.txt", "bookings.txt"};
+            if (dataDir.empty()) names.push_back("ref_counter.txt");
+            for (const string& name : names)
+                if (!force && filesystem::exists(dataFile(dataDir, name)))
+                    throw runtime_error(name + " already exists " + (dataDir.empty() ? "here" : "in " + dataDir) +
+                                        "; use --force to replace the hotel's data");
+            generateHotelData(generateRooms, generateBookings, generateSeed, dataDir);
+            return 0;
+        }
+
+        if (!task.empty()) {
+            auto count = [&](size_t k, size_t fallback) { return k < taskArgs.size() ? stoul(taskArgs[k]) : fallback; };
+            if (task == "--bench") runBenchmarkSuite(count(0, 10000), count(1, 100000), static_cast<int>(count(2, 5)), count(3, 100));
+            else if (task == "--bench-parse") runParseBenchmark(count(0, 200000));
+            else if (task == "--bench-memory") runMemoryBenchmark(dataDir);
+            else if (task == "--bench-views") runViewBenchmark(count(0, 1000000), taskArgs.size() > 1 ? stod(taskArgs[1]) : 2);
+            else if (task == "--bench-durability") runDurabilityBenchmark(max<size_t>(1, count(0, 8)), count(1, 400));
+            else if (task == "--bench-properties") runPropertyBenchmark(max<size_t>(1, count(0, 50)), count(1, 200), count(2, 2000));
+            else {
+                int processes = static_cast<int>(count(0, 8)), operations = static_cast<int>(count(1, 500));
+                bool ok = true;
+                for (int roomsPerShard : {0, 5}) { // The test's 20 rooms in one file pair, then in five shards
+                    ShardLayout layout;
+                    layout.roomsPerShard = roomsPerShard;
+                    ok = runStressTest(processes, operations, StorageMode::Journal, layout) && ok;
+                    ok = runStressTest(processes, operations, StorageMode::Rewrite, layout) && ok;
+                }
+                return ok ? 0 : 1;
+            }
+            return 0;
+        }
+
+        if (!statsPath.empty()) {
+#if HOTEL_STATS
+            statsJsonPath = statsPath;
+            startStatsSignalWatcher(batchPath.empty() && !serve && !report && loadClients == 0 && propertySearch.empty());
+            atexit(dumpStatsAtExit);
+#else
+            cerr << "Statistics were compiled out of this build; ignoring --stats-json\n";
+#endif
+        }
+
+        if (!propertySearch.empty()) {
+            runPropertySearch(propertySearch, mode, threads);
+            return 0;
+        }
+
+        if (!migrateTo.empty()) {
+            ShardLayout target = ShardLayout::parse(migrateTo);
+            HotelStore store(dataDir); // Rewrite mode, so load() folds any journal into the current files first
+            store.load();
+            string from = store.dataLayout().describe();
+            store.migrateLayout(target);
+            cout << "Moved " << store.allRooms().size() << " rooms and " << store.bookingCount() << " bookings from "
+                 << from << " to " << target.describe() << "\n";
+            return 0;
+        }
+
+        if (loadClients > 0) {
+            runLoadTest(socketPath, loadClients, loadSeconds);
+            return 0;
+        }
+
+        if (batchPath.empty() && importPath.empty() && !serve && !report) cout << "=== HOTEL RESERVATION SYSTEM ===\n";
+
+        HotelStore store(dataDir);
+        store.setStorageMode(mode, compactEvery);
+        store.setSnapshotsEnabled(snapshots);
+        store.setDurability(durability, chrono::microseconds(groupWindow), groupSize);
+        store.load(); // Data files are read once and kept in memory
+        pricing();    // So is the rate table; a malformed rates.txt stops us here
+
+        if (!batchPath.empty()) return runBatch(store, batchPath) == 0 ? 0 : 1;
+        if (!importPath.empty()) return runRoomImport(store, importPath) == 0 ? 0 : 1;
+        if (report) {
+            printRevenueReport(store, today());
+            return 0;
+        }
+        if (serve) {
+            runServer(store, socketPath, threads);
+            return 0;
+        }
+
         while (true) {
             User* user = nullptr;
-            while (!user) user = login(); // Keep prompting until valid login
+            while (!user) user = login(store); // Keep prompting until valid login
 
             user->showMenu(); // Display user-specific menu
             delete user; // Clean up user object
@@ -815,6 +6866,7 @@ int main() {
         }
     } catch (const exception& e) {
         cerr << "Fatal error: " << e.what() << "\n";
+        return 1;
     }
     return 0;
 }